@@ -164,7 +164,8 @@ int main(void) {
     gpio_setup();
     i2c_setup();
 
-    uint8_t read[NUM_BLOCKS][BLOCK_SIZE] = {0};
+    /* 2KB, too much for the stack: static, so it lives in .bss (zeroed) */
+    static uint8_t read[NUM_BLOCKS][BLOCK_SIZE];
     uint8_t write[2] = {0};
     uint8_t eeprom_slave_addr;
     uint8_t byte_address;
@@ -0,0 +1,32 @@
+/**********************************************************************************
+ ** file         : boot.h
+ ** description  : boot time milestones, counted from reset
+ **
+ **
+ **********************************************************************************/
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+
+enum boot_point {
+    BOOT_MAIN,          /* .data copied, .bss zeroed, entering main() */
+    BOOT_CLOCK,         /* running at 72MHz (HSE + PLL locked) */
+    BOOT_SENSOR,        /* `paw_init()` done */
+    BOOT_REPORT,        /* first HID report written, i.e. host configured us */
+    BOOT_POINTS
+};
+
+/* what `MOUSE_REQ_GET_BOOT` sends back: µs since reset for each point,
+ * 0 if not reached yet, plus the raw cycles of the startup code (at the
+ * 8MHz reset clock) since that's the part a few cycles matter in */
+struct boot_stats {
+    uint32_t us[BOOT_POINTS];
+    uint32_t startup_cycles;
+} __attribute__((packed));
+
+void boot_mark(enum boot_point point);
+void boot_get(struct boot_stats *stats);
+
+#endif
@@ -0,0 +1,68 @@
+/**********************************************************************************
+ ** file         : buttons.h
+ ** description  : table-driven SPDT (NO/NC) button debounce over EXTI
+ **
+ **
+ **********************************************************************************/
+
+#ifndef BUTTONS_H
+#define BUTTONS_H
+
+#include <stdint.h>
+#include "device.h"
+
+/* --- CONFIGURATION ----------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* number of entries in the button table (buttons.c), bit i of the state is button i */
+#define BUTTON_COUNT    2
+
+/* how the pins are watched:
+ *   0: EXTI, one interrupt per (unmasked) edge
+ *   1: TIM3 triggers DMA copies of GPIOA/GPIOB->IDR into a ring buffer at a
+ *      fixed rate, and the latch runs over it in batches. a bouncing switch
+ *      costs nothing extra, and every change lands on a fixed time grid.
+ *      buttons must be on GPIOA/GPIOB in this mode */
+#define BUTTONS_DMA             0
+
+/* DMA mode: samples per second, and samples per batch (half the ring).
+ * 50kHz / 10 = a batch every 200us, which also bounds the added latency */
+#define BUTTONS_DMA_RATE_HZ     50000
+#define BUTTONS_DMA_BATCH       10
+
+/* button state changes waiting for the report path, power of 2. a report
+ * goes out every 1ms and the latch can't flip faster than the switch can
+ * travel, so a handful is plenty */
+#define BUTTON_QUEUE_SIZE   16
+
+/* a button is a pair of pins off an SPDT switch, both pulled up and pulled
+ * low by the common terminal. pins are given by number (0-15), which is also
+ * their EXTI line, so no two pins in the table may share a number */
+struct button {
+    GPIO_T  *no_port;
+    uint8_t  no_pin;
+    GPIO_T  *nc_port;
+    uint8_t  nc_pin;
+};
+
+/* one state change, stamped with the DWT cycle counter at ISR entry */
+struct button_event {
+    uint8_t  state;
+    uint32_t stamp;
+};
+
+/* called from the EXTI ISRs on every state change, after it's been queued.
+ * `first` is set if nothing older was waiting in the queue, i.e. the state
+ * the host last got (or is about to get) is the one right before this */
+typedef void (*button_callback)(const struct button_event *ev, uint8_t first);
+
+/* --- FUNCTION DECLARATIONS --------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+void     buttons_init(void);
+uint8_t  buttons_get(void);
+int      buttons_pop(struct button_event *ev);
+uint32_t buttons_dropped(void);
+void     buttons_register_callback(button_callback cb);
+
+#endif
@@ -1,6 +1,6 @@
 /**********************************************************************************
  ** file         : delay.h
- ** description  : 
+ ** description  : 64-bit µs timebase on TIM2, and delays built on it
  **
  **
  **********************************************************************************/
@@ -10,7 +10,11 @@
 
 #include <stdint.h>
 
+void timebase_init(void);
+uint64_t time_us(void);
+
+void delay_until(uint64_t deadline);
 void delay_ms(uint32_t ms);
 void delay_us(uint16_t us);
 
-#endif
\ No newline at end of file
+#endif
@@ -145,6 +145,55 @@ typedef struct {
     IO32 STIR;
 }  NVIC_T;
 
+typedef struct {
+    IO32 CCR;
+    IO32 CNDTR;
+    IO32 CPAR;
+    IO32 CMAR;
+    IO32 RESERVED0;
+} DMA_CHANNEL_T;
+
+typedef struct {
+    IO32 ISR;
+    IO32 IFCR;
+    DMA_CHANNEL_T CH[7];    /* CH[0] is channel 1 */
+} DMA_T;
+
+typedef struct {
+    IO32 CTRL;
+    IO32 CYCCNT;
+    IO32 CPICNT;
+    IO32 EXCCNT;
+    IO32 SLEEPCNT;
+    IO32 LSUCNT;
+    IO32 FOLDCNT;
+    IO32 PCSR;
+} DWT_T;
+
+typedef struct {
+    IO32 DHCSR;
+    IO32 DCRSR;
+    IO32 DCRDR;
+    IO32 DEMCR;
+} COREDEBUG_T;
+
+typedef struct {
+    IO32 CPUID;
+    IO32 ICSR;
+    IO32 VTOR;
+    IO32 AIRCR;
+    IO32 SCR;
+    IO32 CCR;
+    IO8  SHPR[12];      /* system handler priorities, SHPR[n] is exception n + 4 */
+    IO32 SHCSR;
+    IO32 CFSR;
+    IO32 HFSR;
+    IO32 DFSR;
+    IO32 MMFAR;
+    IO32 BFAR;
+    IO32 AFSR;
+} SCB_T;
+
 /* --- BITFIELDS --------------------------------------------------------------------- */
 /* ----------------------------------------------------------------------------------- */
 
@@ -199,6 +248,16 @@ typedef struct {
 #define USB_ISTR_EP_ID_Shft         0U
 #define USB_DADDR_ADDR_Shft         0U
 
+#define TIM_SMCR_SMS_Shft           0U
+#define DMA_CCR_PSIZE_Shft          8U
+#define DMA_CCR_MSIZE_Shft          10U
+#define DMA_CCR_PL_Shft             12U
+
+#define TIM_CCMR1_CC1S_Shft         0U
+#define TIM_CCMR1_IC1F_Shft         4U
+#define TIM_CCMR1_CC2S_Shft         8U
+#define TIM_CCMR1_IC2F_Shft         12U
+
 #define SPI_CR1_BR_Shft             3U
 #define SPI_DR_DR_Shft              0U
 #define SPI_CRCPR_CRCPOLY_Shft      0U
@@ -282,6 +341,16 @@ typedef struct {
 #define USB_EPR_RC_W0_Msk           (USB_EPR_CTR_TX_Msk | USB_EPR_CTR_RX_Msk)
 #define USB_ISTR_EP_ID_Msk          (0b1111 << USB_ISTR_EP_ID_Shft)
 
+#define TIM_SMCR_SMS_Msk            (0b111  << TIM_SMCR_SMS_Shft)
+#define DMA_CCR_PSIZE_Msk           (0b11   << DMA_CCR_PSIZE_Shft)
+#define DMA_CCR_MSIZE_Msk           (0b11   << DMA_CCR_MSIZE_Shft)
+#define DMA_CCR_PL_Msk              (0b11   << DMA_CCR_PL_Shft)
+
+#define TIM_CCMR1_CC1S_Msk          (0b11   << TIM_CCMR1_CC1S_Shft)
+#define TIM_CCMR1_IC1F_Msk          (0b1111 << TIM_CCMR1_IC1F_Shft)
+#define TIM_CCMR1_CC2S_Msk          (0b11   << TIM_CCMR1_CC2S_Shft)
+#define TIM_CCMR1_IC2F_Msk          (0b1111 << TIM_CCMR1_IC2F_Shft)
+
 #define SPI_CR1_BR_Msk              (0b111  << SPI_CR1_BR_Shft)
 #define SPI_DR_DR_Msk               (0b111111111111111 << SPI_DR_DR_Shft)
 #define SPI_CRCPR_CRCPOLY_Msk       (0b111111111111111 << SPI_CRCPR_CRCPOLY_Shft)
@@ -404,6 +473,12 @@ typedef struct {
 #define RCC_APB1RSTR_PWRRST_        (1 << 28)
 #define RCC_APB1RSTR_DACRST_        (1 << 29)
 
+#define RCC_AHBENR_DMA1EN_          (1 << 0)
+#define RCC_AHBENR_DMA2EN_          (1 << 1)
+#define RCC_AHBENR_SRAMEN_          (1 << 2)
+#define RCC_AHBENR_FLITFEN_         (1 << 4)
+#define RCC_AHBENR_CRCEN_           (1 << 6)
+
 #define RCC_APB2ENR_AFIOEN_         (1 << 0)
 #define RCC_APB2ENR_IOPAEN_         (1 << 2)
 #define RCC_APB2ENR_IOPBEN_         (1 << 3)
@@ -556,9 +631,28 @@ typedef struct {
 /* ---  TIM ---------------------------------------------------------------- */
 
 #define TIM_CR1_CEN_                (1 << 0)
+#define TIM_CR1_URS_                (1 << 2)    /* only counter over/underflow raises UIF, not UG */
 
 #define TIM_EGR_UG_                 (1 << 0)
 
+#define TIM_SR_UIF_                 (1 << 0)
+
+#define TIM_DIER_UIE_               (1 << 0)    /* update interrupt */
+#define TIM_DIER_UDE_               (1 << 8)    /* update DMA request */
+#define TIM_DIER_CC1DE_             (1 << 9)    /* CC1 DMA request */
+
+#define TIM_SMCR_SMS_ENCODER3       (0b011 << TIM_SMCR_SMS_Shft)    /* encoder mode 3: count on TI1 and TI2 edges */
+
+#define TIM_CCMR1_CC1S_TI1          (0b01 << TIM_CCMR1_CC1S_Shft)   /* CC1 = input, IC1 on TI1 */
+#define TIM_CCMR1_CC2S_TI2          (0b01 << TIM_CCMR1_CC2S_Shft)   /* CC2 = input, IC2 on TI2 */
+#define TIM_CCMR1_IC1F_DTS32_N8     (0b1111 << TIM_CCMR1_IC1F_Shft) /* longest input filter */
+#define TIM_CCMR1_IC2F_DTS32_N8     (0b1111 << TIM_CCMR1_IC2F_Shft)
+
+#define TIM_CCER_CC1E_              (1 << 0)
+#define TIM_CCER_CC1P_              (1 << 1)    /* input: 1 = inverted */
+#define TIM_CCER_CC2E_              (1 << 4)
+#define TIM_CCER_CC2P_              (1 << 5)
+
 /* ---  SPI ---------------------------------------------------------------- */
 
 #define SPI_CR1_CPHA_               (1 << 0)    /* clock phase: capture data on 1st or 2nd (0 or 1) clock transition */
@@ -676,10 +770,64 @@ typedef struct {
 
 /* ---  STK ---------------------------------------------------------------- */
 
+#define STK_CSR_COUNTFLAG_          (1 << 16)   /* 1 = reached 0 since last read, cleared by reading */
 #define STK_CSR_CLKSOURCE_AHBDIV    (1 << 2)    /* 0 = AHB/8, 1 = AHB */
 #define STK_CSR_TICKINT_            (1 << 1)    /* 1 = enable systick interrupt */
 #define STK_CSR_ENABLE_             (1 << 0)    /* 1 = enable systick counter */
 
+/* ---  DMA ---------------------------------------------------------------- */
+
+#define DMA_CCR_EN_                 (1 << 0)
+#define DMA_CCR_TCIE_               (1 << 1)    /* transfer complete interrupt */
+#define DMA_CCR_HTIE_               (1 << 2)    /* half transfer interrupt */
+#define DMA_CCR_TEIE_               (1 << 3)    /* transfer error interrupt */
+#define DMA_CCR_DIR_                (1 << 4)    /* 0 = periph -> mem, 1 = mem -> periph */
+#define DMA_CCR_CIRC_               (1 << 5)
+#define DMA_CCR_PINC_               (1 << 6)
+#define DMA_CCR_MINC_               (1 << 7)
+#define DMA_CCR_MEM2MEM_            (1 << 14)
+
+#define DMA_CCR_PSIZE_8             (0b00 << DMA_CCR_PSIZE_Shft)
+#define DMA_CCR_PSIZE_16            (0b01 << DMA_CCR_PSIZE_Shft)
+#define DMA_CCR_PSIZE_32            (0b10 << DMA_CCR_PSIZE_Shft)
+#define DMA_CCR_MSIZE_8             (0b00 << DMA_CCR_MSIZE_Shft)
+#define DMA_CCR_MSIZE_16            (0b01 << DMA_CCR_MSIZE_Shft)
+#define DMA_CCR_MSIZE_32            (0b10 << DMA_CCR_MSIZE_Shft)
+#define DMA_CCR_PL_LOW              (0b00 << DMA_CCR_PL_Shft)
+#define DMA_CCR_PL_MEDIUM           (0b01 << DMA_CCR_PL_Shft)
+#define DMA_CCR_PL_HIGH             (0b10 << DMA_CCR_PL_Shft)
+#define DMA_CCR_PL_VERYHIGH         (0b11 << DMA_CCR_PL_Shft)
+
+/* ISR/IFCR: 4 flags per channel, channels numbered from 1 */
+#define DMA_ISR_GIF(ch)             (1 << (((ch) - 1) * 4 + 0))
+#define DMA_ISR_TCIF(ch)            (1 << (((ch) - 1) * 4 + 1))
+#define DMA_ISR_HTIF(ch)            (1 << (((ch) - 1) * 4 + 2))
+#define DMA_ISR_TEIF(ch)            (1 << (((ch) - 1) * 4 + 3))
+#define DMA_IFCR_CGIF(ch)           DMA_ISR_GIF(ch)
+
+/* ---  DWT ---------------------------------------------------------------- */
+
+#define DWT_CTRL_CYCCNTENA_         (1 << 0)    /* 1 = enable cycle counter */
+
+/* ---  COREDEBUG ---------------------------------------------------------- */
+
+#define COREDEBUG_DEMCR_TRCENA_     (1 << 24)   /* 1 = enable DWT and ITM */
+
+/* ---  SCB ---------------------------------------------------------------- */
+
+#define SCB_ICSR_PENDSTCLR_         (1 << 25)   /* 1 = clear pending SysTick */
+#define SCB_ICSR_PENDSTSET_         (1 << 26)   /* 1 = set pending SysTick, reads 1 if pending */
+
+#define SCB_SHPR_SYSTICK            11          /* SHPR index of SysTick (exception 15) */
+#define SCB_SHPR_PENDSV             10          /* SHPR index of PendSV (exception 14) */
+
+/* --- NVIC PRIORITIES ---------------------------------------------------------------- */
+
+/* the F103 implements the top 4 bits of each 8-bit priority field: 16 levels,
+ * 0 = highest. with AIRCR.PRIGROUP at its reset value (0) all 4 are
+ * preemption bits, there are no subpriorities */
+#define NVIC_PRIO_BITS              4
+
 /* --- NVIC IRQ Numbers -------------------------------------------------------------- */
 /* ----------------------------------------------------------------------------------- */
 
@@ -752,6 +900,8 @@ typedef struct {
 #define NVIC_CAN2_SCE_IRQ           66
 #define NVIC_OTG_FS_IRQ             67
 
+#define NVIC_IRQ_COUNT              68
+
 /* --- POINTERS ---------------------------------------------------------------------- */
 /* ----------------------------------------------------------------------------------- */
 
@@ -763,6 +913,8 @@ typedef struct {
 #define EXTI        ((EXTI_T *)     0x40010400)
 #define USB         ((USB_T *)      0x40005C00)
 #define TIM2        ((TIM_T *)      0x40000000)
+#define TIM3        ((TIM_T *)      0x40000400)
+#define TIM4        ((TIM_T *)      0x40000800)
 #define FLASH_ACR   (*(IO32 *)      0x40022000)
 #define SPI1        ((SPI_T *)      0x40013000)
 #define SPI2        ((SPI_T *)      0x40003800)
@@ -770,5 +922,9 @@ typedef struct {
 #define I2C1        ((I2C_T *)      0x40005400)
 #define STK         ((STK_T *)      0xE000E010)
 #define NVIC        ((NVIC_T *)     0xE000E100)
+#define DMA1        ((DMA_T *)      0x40020000)
+#define DWT         ((DWT_T *)      0xE0001000)
+#define COREDEBUG   ((COREDEBUG_T *)0xE000EDF0)
+#define SCB         ((SCB_T *)      0xE000ED00)
 
 #endif
\ No newline at end of file
@@ -0,0 +1,41 @@
+/**********************************************************************************
+ ** file         : dwt.h
+ ** description  : cycle counter (DWT CYCCNT) timestamps and busy-waits
+ **
+ **                unlike nop loops these don't depend on the optimization
+ **                level or on flash wait states, and follow `sysclk_hz`.
+ **
+ **********************************************************************************/
+
+#ifndef DWT_H
+#define DWT_H
+
+#include <stdint.h>
+#include "device.h"
+#include "rcc.h"
+
+/* the DWT is part of the debug block, which has to be switched on first.
+ * CYCCNT keeps running from here on and is never reset, it's shared */
+static inline void dwt_init(void) {
+    COREDEBUG->DEMCR |= COREDEBUG_DEMCR_TRCENA_;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_;
+}
+
+/* wraps every ~60s at 72MHz, fine for deltas well under that */
+static inline uint32_t now_cycles(void) {
+    return DWT->CYCCNT;
+}
+
+/* at least `cycles`, plus a few for the call and the last compare */
+static inline void delay_cycles(uint32_t cycles) {
+    uint32_t start = DWT->CYCCNT;
+    while (DWT->CYCCNT - start < cycles);
+}
+
+/* at least `ns`, rounded up to whole cycles. `ns` must stay below
+ * 2^32 / (sysclk in MHz), i.e. ~59ms at 72MHz */
+static inline void delay_ns(uint32_t ns) {
+    delay_cycles((ns * (sysclk_hz / 1000000) + 999) / 1000);
+}
+
+#endif
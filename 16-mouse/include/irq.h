@@ -0,0 +1,85 @@
+/**********************************************************************************
+ ** file         : irq.h
+ ** description  : interrupt priority map, BASEPRI critical sections
+ **
+ **
+ **********************************************************************************/
+
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+#include "device.h"
+
+/* --- PRIORITY MAP ------------------------------------------------------------------ */
+/* ----------------------------------------------------------------------------------- */
+
+/* 0 = highest, 15 = lowest (NVIC_PRIO_BITS). a higher priority ISR preempts
+ * a lower one, equal priorities never preempt each other.
+ *
+ * BUTTONS:  click EXTI lines, or the DMA sampling ISR. nothing may hold off
+ *           a click. they're all producers of the same SPSC queue
+ *           (buttons.c), which relies on them not preempting each other:
+ *           keep them at one level.
+ * TIMEBASE: TIM2 overflow. a few instructions, and `time_us()` copes with
+ *           it being late, so it sits right under the buttons.
+ * USB:      the USB ISR only masks itself and posts an event, the work runs
+ *           in the main loop (sched.c).
+ * SYSTICK:  housekeeping: the timer wheel and its callbacks. timers may only
+ *           be started/stopped from here or from thread mode.
+ *
+ * 0 is left free: BASEPRI can't mask it, so it's for whatever must never be
+ * held off by a critical section. */
+#define IRQ_PRIO_BUTTONS    1
+#define IRQ_PRIO_TIMEBASE   2
+#define IRQ_PRIO_USB        4
+#define IRQ_PRIO_SYSTICK    8
+
+/* move the vector table to RAM at boot (`irq_vectors_to_ram()`): exception
+ * entry fetches the vector without flash wait states, and `irq_bind()` can
+ * swap handlers at runtime. 0 keeps the const table in flash */
+#define IRQ_RAM_VECTORS     1
+
+/* system exceptions for `irq_bind()`, as negative numbers below the NVIC
+ * ones (vector n is irq n - 16) */
+#define IRQ_PENDSV          -2
+#define IRQ_SYSTICK         -1
+
+/* --- FUNCTIONS --------------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+typedef void (*irq_handler)(void);
+
+void        irq_vectors_to_ram(void);
+irq_handler irq_bind(int32_t irq, irq_handler handler);
+
+static inline void irq_set_priority(uint32_t irq, uint8_t prio) {
+    NVIC->IPR[irq] = prio << (8 - NVIC_PRIO_BITS);
+}
+
+static inline void irq_enable(uint32_t irq) {
+    NVIC->ISER[irq / 32] = (1 << (irq % 32));
+}
+
+static inline void irq_disable(uint32_t irq) {
+    NVIC->ICER[irq / 32] = (1 << (irq % 32));
+}
+
+/* critical section against ISRs at `prio` and below, anything above still
+ * runs. BASEPRI_MAX only ever raises the mask, so these nest: pass the
+ * returned value to `irq_unmask()`. `prio` must not be 0 (see above) */
+static inline uint32_t irq_mask(uint8_t prio) {
+
+    uint32_t old;
+
+    __asm__ volatile ("mrs %0, basepri" : "=r" (old));
+    __asm__ volatile ("msr basepri_max, %0" :: "r" (prio << (8 - NVIC_PRIO_BITS)) : "memory");
+
+    return old;
+}
+
+static inline void irq_unmask(uint32_t old) {
+    __asm__ volatile ("msr basepri, %0" :: "r" (old) : "memory");
+}
+
+#endif
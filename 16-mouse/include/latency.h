@@ -0,0 +1,38 @@
+/**********************************************************************************
+ ** file         : latency.h
+ ** description  : button edge -> report collected latency histogram
+ **
+ **
+ **********************************************************************************/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+/* --- CONFIGURATION ----------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+#define LATENCY_BIN_US          125     /* 16 bins: 0 - 2ms, last one catches the rest */
+#define LATENCY_BINS            16
+
+/* what `MOUSE_REQ_GET_LATENCY` sends back, fits in one ep0 packet */
+struct latency_stats {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint16_t bin_us;
+    uint16_t nbins;
+    uint16_t bins[LATENCY_BINS];
+    uint32_t dropped;           /* changes lost to a full button queue, never timed */
+} __attribute__((packed));
+
+/* --- FUNCTION DECLARATIONS --------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+void     latency_init(void);
+void     latency_record(uint32_t start);
+void     latency_get(struct latency_stats *stats);
+void     latency_reset(void);
+
+#endif
@@ -0,0 +1,41 @@
+/**********************************************************************************
+ ** file         : motion.h
+ ** description  : motion transform stage between the sensor and the hid report
+ **
+ **
+ **********************************************************************************/
+
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <stdint.h>
+
+/* --- ROTATION ---------------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* angle correction in whole degrees, any value is wrapped into [0, 360).
+ * positive angles turn the pointer clockwise on screen (hid Y points down) */
+#define MOTION_ANGLE_MIN    -180
+#define MOTION_ANGLE_MAX    180
+
+/* --- SENSITIVITY CURVE ------------------------------------------------------------ */
+/* ----------------------------------------------------------------------------------- */
+
+/* gain as a function of per-frame speed (counts/frame), piecewise linear
+ * between MOTION_CURVE_POINTS equally spaced points. point i sits at speed
+ * i << step_shift, past the last point the gain stays flat. gains are Q8.8,
+ * so 256 is 1.0x */
+#define MOTION_CURVE_POINTS     16
+#define MOTION_CURVE_SHIFT_MAX  10
+#define MOTION_GAIN_ONE         256
+
+/* --- FUNCTION DECLARATIONS --------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+void    motion_set_angle(int16_t deg);
+int16_t motion_get_angle(void);
+int     motion_curve_set_point(uint8_t idx, uint16_t gain);
+int     motion_curve_commit(uint8_t enable, uint8_t step_shift);
+void    motion_apply(int16_t *dx, int16_t *dy);
+
+#endif
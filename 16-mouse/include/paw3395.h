@@ -10,9 +10,20 @@
 
 #include <stdint.h>
 
+/* --- CONFIGURATION ----------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
 #define MAX_BURST_SIZE  12
 #define BURST_SIZE      6
 
+/* section 6.4: resolution is set in 50 DPI steps, 50 to 26000 DPI */
+#define PAW3395_DPI_STEP            50
+#define PAW3395_DPI_MIN             50
+#define PAW3395_DPI_MAX             26000
+
+/* from this resolution up, ripple control (CTRL8) is turned on */
+#define PAW3395_DPI_RIPPLE          9000
+
 /* --- REGISTER ADDRESSES ------------------------------------------------------------ */
 /* ----------------------------------------------------------------------------------- */
 
@@ -27,20 +38,111 @@
 #define PAW3395_RES_Y_HIGH          0x4B
 #define PAW3395_RIPPLE_CONTROL      0x5A
 #define PAW3395_AXIS_CONTROL        0x5B
+#define PAW3395_RUN_DOWNSHIFT       0x77
+#define PAW3395_REST1_PERIOD        0x78
+#define PAW3395_REST1_DOWNSHIFT     0x79
+#define PAW3395_REST2_PERIOD        0x7A
+#define PAW3395_REST2_DOWNSHIFT     0x7B
+#define PAW3395_REST3_PERIOD        0x7C
+#define PAW3395_BANK_SELECT         0x7F
 
 /* --- BITFIELDS --------------------------------------------------------------------- */
 /* ----------------------------------------------------------------------------------- */
 
+#define PAW3395_PERFORMANCE_MODE_Msk    (0b11 << 0)
 #define PAW3395_PERFORMANCE_AWAKE_      (1 << 7)
 #define PAW3395_SET_RESOLUTION_SET_RES_ (1 << 0)
 #define PAW3395_RIPPLE_CONTROL_CTRL8_   (1 << 7)
 #define PAW3395_AXIS_CONTROL_INVX_      (1 << 5)
 
+/* --- SPI TIMING ------------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* section 5: SPI timing. gaps are measured from the last SCLK edge of one
+ * transaction to the first SCLK edge of the next, see `paw_wait_idle()` */
+
+#define PAW3395_SCLK_MAX_HZ             10000000
+#define PAW3395_T_NCS_SCLK_NS           120     /* NCS low to first SCLK edge       */
+#define PAW3395_T_SCLK_NCS_READ_NS      120     /* last SCLK edge to NCS high, read  */
+#define PAW3395_T_SCLK_NCS_WRITE_NS     1000    /* last SCLK edge to NCS high, write */
+#define PAW3395_T_SRAD_US               2       /* read: address to data            */
+#define PAW3395_T_SRAD_MOTBR_US         2       /* motion burst: address to data    */
+#define PAW3395_T_SWW_US                5       /* write to next write              */
+#define PAW3395_T_SWR_US                5       /* write to next read               */
+#define PAW3395_T_SRW_US                2       /* read to next write               */
+#define PAW3395_T_SRR_US                2       /* read to next read                */
+#define PAW3395_T_BEXIT_NS              500     /* end of motion burst to next NCS  */
+
+/* --- REGISTER SEQUENCES ----------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* register addresses are 7 bits, so opcodes live above 0x7F and a sequence is
+ * just a byte string: 
+ *
+ *   BANK  <bank> <n> <addr> <data> ... : select bank, then n register writes
+ *   DELAY <ms>                         : release CS and wait
+ *   POLL  <addr> <val> <tries> <skip>  : read addr once per ms until it reads val.
+ *                                        on a match, skip the next <skip> bytes
+ *                                        (the fallback ops), else run them
+ *   END
+ *
+ * see `paw_run_sequence()`.
+ */
+
+#define PAW_OP_BANK     0x80
+#define PAW_OP_DELAY    0x81
+#define PAW_OP_POLL     0x82
+#define PAW_OP_END      0xFF
+
+#define PAW_SEQ_BYTES(...)  (sizeof((uint8_t[]){__VA_ARGS__}))
+
+#define PAW_SEQ_BANK(bank, ...) \
+    PAW_OP_BANK, (bank), (PAW_SEQ_BYTES(__VA_ARGS__) / 2), __VA_ARGS__
+
+#define PAW_SEQ_DELAY(ms) \
+    PAW_OP_DELAY, (ms)
+
+#define PAW_SEQ_POLL(addr, val, tries, ...) \
+    PAW_OP_POLL, (addr), (val), (tries), PAW_SEQ_BYTES(__VA_ARGS__), __VA_ARGS__
+
+#define PAW_SEQ_END \
+    PAW_OP_END
+
+/* --- OPERATING MODES -------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* section 7: values double as PERFORMANCE[1:0] */
+enum paw_mode {
+    PAW_MODE_HIGH_PERFORMANCE,
+    PAW_MODE_LOW_POWER,
+    PAW_MODE_OFFICE,
+    PAW_MODE_CORDED_GAMING,
+    PAW_MODE_COUNT,
+};
+
+/* rest mode timing, raw register values (see section 7 for units) */
+struct paw_rest_timing {
+    uint8_t run_downshift;
+    uint8_t rest1_period;
+    uint8_t rest1_downshift;
+    uint8_t rest2_period;
+    uint8_t rest2_downshift;
+    uint8_t rest3_period;
+};
+
 /* --- FUNCTION DECLARATIONS --------------------------------------------------------- */
 /* ----------------------------------------------------------------------------------- */
 
 void paw_motion_burst(uint8_t *byte, uint8_t len);
+void paw_run_sequence(const uint8_t *seq);
+int  paw_shadow_verify(void);
 void paw_init(void);
 void paw_set_dpi(uint16_t dpi);
+void paw_set_resolution(uint16_t dpi_x, uint16_t dpi_y);
+void paw_get_resolution(uint16_t *dpi_x, uint16_t *dpi_y);
+void paw_set_mode(enum paw_mode mode);
+enum paw_mode paw_get_mode(void);
+void paw_set_rest(uint8_t enable);
+void paw_set_rest_timing(const struct paw_rest_timing *timing);
 
 #endif
@@ -8,6 +8,11 @@
 #ifndef RCC_H
 #define RCC_H
 
+#include <stdint.h>
+
+/* current SYSCLK, kept up to date by the functions below */
+extern uint32_t sysclk_hz;
+
 void set_sysclk_72mhz(void);
 void set_sysclk_48mhz(void);
 
@@ -0,0 +1,69 @@
+/**********************************************************************************
+ ** file         : sched.h
+ ** description  : run-to-completion event scheduler for the main loop
+ **
+ **
+ **********************************************************************************/
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+/* --- CONFIGURATION ----------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* one entry per event, highest priority first. an event is a flag: posting
+ * one that's already pending does nothing, so a handler must drain whatever
+ * its source has queued up (the usb ISTR, a ring buffer, ...) */
+enum sched_event {
+    SCHED_EV_USB,
+    SCHED_EV_STATS,
+    SCHED_EV_COUNT
+};
+
+/* a handler running longer than this counts as an overrun: one report
+ * interval, anything above may delay the next IN */
+#define SCHED_BUDGET_US     1000
+
+/* per event, what `MOUSE_REQ_GET_SCHED` sends back */
+struct sched_stats {
+    uint32_t runs;
+    uint32_t max_cycles;
+    uint32_t overruns;
+} __attribute__((packed));
+
+/* what `MOUSE_REQ_GET_IDLE` sends back. tick latencies are from the SysTick
+ * interrupt firing to its ISR running: after waking from a stretched sleep,
+ * and in normal operation for comparison. SysTick waits for the timer wheel
+ * to catch up after a sleep, the other ISRs don't: theirs are measured
+ * separately, from the WFI returning to their entry (`sched_woken()`) */
+struct idle_stats {
+    uint32_t sleeps;
+    uint32_t tickless;          /* sleeps with SysTick stretched past one tick */
+    uint32_t asleep_us;
+    uint32_t wakes;             /* stretched sleeps that ran to the end (tick wake-ups) */
+    uint32_t wake_max_cycles;
+    uint32_t tick_max_cycles;
+    uint32_t irq_wakes;         /* sleeps ended by a click or usb interrupt */
+    uint32_t irq_wake_max_cycles;
+} __attribute__((packed));
+
+_Static_assert(SCHED_EV_COUNT <= 32, "events are bits of one word");
+
+/* --- FUNCTION DECLARATIONS --------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+typedef void (*sched_handler)(void);
+
+void sched_register(enum sched_event ev, sched_handler handler);
+void sched_post(enum sched_event ev);
+void sched_run(void) __attribute__((noreturn));
+
+void sched_get_stats(struct sched_stats *stats);
+void sched_reset_stats(void);
+void sched_woken(uint32_t now);
+void sched_get_idle_stats(struct idle_stats *stats);
+void sched_reset_idle_stats(void);
+
+#endif
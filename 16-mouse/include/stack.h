@@ -0,0 +1,25 @@
+/**********************************************************************************
+ ** file         : stack.h
+ ** description  : stack reserve high-water mark
+ **
+ **
+ **********************************************************************************/
+
+#ifndef STACK_H
+#define STACK_H
+
+#include <stdint.h>
+
+/* what the reserve is filled with at boot, anything else has been used */
+#define STACK_PAINT     0xc5c5c5c5
+
+/* what `MOUSE_REQ_GET_STACK` sends back, in bytes. `used_max` equal to
+ * `reserve` means the stack got to (or past) the bottom of the reserve */
+struct stack_stats {
+    uint32_t reserve;
+    uint32_t used_max;
+} __attribute__((packed));
+
+void stack_get(struct stack_stats *stats);
+
+#endif
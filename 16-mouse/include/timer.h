@@ -0,0 +1,57 @@
+/**********************************************************************************
+ ** file         : timer.h
+ ** description  : software timers on a two-level timer wheel, ticked by SysTick
+ **
+ **
+ **********************************************************************************/
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* --- CONFIGURATION ----------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+#define TIMER_TICK_HZ       1000    /* 1 tick = 1ms */
+
+/* the near wheel has one slot per tick, the far wheel one slot per lap of
+ * the near wheel: 256 slots x 64 slots covers 16.4s at 1ms. longer timers
+ * still work, they're just re-filed into the far wheel until they're close */
+#define TIMER_NEAR_BITS     8
+#define TIMER_FAR_BITS      6
+
+/* --- TYPES ------------------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* runs in the SysTick ISR: keep it short, set a flag or post an event */
+typedef void (*timer_callback)(void *arg);
+
+/* owned by the caller (static or otherwise long-lived), the wheel only links
+ * it in. all fields are private to timer.c */
+struct timer {
+    struct timer  *next;
+    struct timer **pprev;       /* the pointer pointing at us, NULL if not armed */
+    uint32_t       expires;     /* in ticks */
+    uint32_t       period;      /* 0 = one-shot */
+    timer_callback callback;
+    void          *arg;
+};
+
+/* --- FUNCTION DECLARATIONS --------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+void     timer_init(void);
+uint32_t timer_ticks(void);
+
+uint32_t timer_sleep_begin(void);
+void     timer_sleep_end(void);
+void     timer_get_wake_stats(uint32_t *wakes, uint32_t *wake_max_cycles, uint32_t *tick_max_cycles);
+void     timer_reset_wake_stats(void);
+
+void timer_setup(struct timer *t, timer_callback callback, void *arg);
+void timer_start(struct timer *t, uint32_t delay, uint32_t period);
+void timer_stop(struct timer *t);
+int  timer_pending(const struct timer *t);
+
+#endif
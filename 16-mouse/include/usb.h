@@ -239,6 +239,7 @@ typedef struct usb_device {
         uint16_t xfer_len;
         int short_xfer;
         usb_ep0_req_complete_callback req_cmpl;
+        uint8_t ctrl_buf[MAX_CIB_PACKET_SIZE];  /* OUT data stages land here */
     } ep0;
 
     struct user_ep0_req_handler {
@@ -287,6 +288,7 @@ void usb_setup_ep(usb_device *dev, uint8_t addr, uint16_t type, uint16_t max_siz
                   usb_endpoint_callback ctr_callback);
 void usb_handle_event(usb_device *dev);
 uint16_t usb_ep_write_packet(usb_device *dev, uint8_t addr, const void *buf, uint16_t len);
+uint16_t usb_ep_patch_packet(usb_device *dev, uint8_t addr, uint16_t offset, const void *buf, uint16_t len);
 uint16_t usb_ep_read_packet(usb_device *dev, uint8_t addr, void *buf, uint16_t len);
 extern int usb_register_ep0_req_handler(usb_device *dev, uint8_t type, 
                                         uint8_t type_mask, usb_ep0_req_handler callback);
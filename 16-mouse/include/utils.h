@@ -11,8 +11,22 @@
 #include <stddef.h>
 
 #define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
 #define ARR_SIZE(x)     (sizeof(x) / sizeof((x)[0]))
 
+/* run from SRAM instead of flash (2 wait states at 72MHz): the linker script
+ * puts `.ramfunc` in `.data`, so the startup copy loads it with the data.
+ * `make RAMFUNCS=0` builds everything in flash, to compare the two */
+#ifndef RAMFUNCS
+#define RAMFUNCS        1
+#endif
+
+#if RAMFUNCS
+#define RAMFUNC         __attribute__((section(".ramfunc"), noinline))
+#else
+#define RAMFUNC
+#endif
+
 void *memcpy(void *dest, const void *src, size_t len);
 void *memset(void *dest, int c, size_t len);
 size_t strlen(const char *str);
@@ -0,0 +1,418 @@
+/********************************************************************
+ ** file         : libusb-test.c
+ ** description  : set dpi / operating mode / angle / sensitivity curve,
+ **                read click latency histogram, scheduler, idle, boot and
+ **                stack stats
+ **
+ ** compilation  : gcc libusb-test.c -lusb-1.0 -o libusb-test
+ **
+ ** permissions  : create a rules file, e.g., `/etc/udev/rules.d/99-stm32mouse.rules`
+ **                and write:
+ **                SUBSYSTEM=="usb", ATTR{idVendor}=="0483", ATTR{idProduct}=="572b", MODE="0666"
+ **
+ ** usage        : ./libusb-test dpi <dpi_x> [dpi_y]
+ **                ./libusb-test mode <mode> <rest>
+ **                ./libusb-test angle <degrees>
+ **                ./libusb-test curve <step_shift> <gain_0> ... <gain_15>  (Q8.8, 256 = 1.0x)
+ **                ./libusb-test curve off
+ **                ./libusb-test latency [clear]
+ **                ./libusb-test sched [clear]
+ **                ./libusb-test idle [clear]
+ **                ./libusb-test boot
+ **                ./libusb-test stack
+ **
+ *******************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libusb-1.0/libusb.h>
+
+#define REQ_SET_DPI         0x01
+#define REQ_SET_PERF_MODE   0x02
+#define REQ_GET_DPI         0x03
+#define REQ_SET_ANGLE       0x04
+#define REQ_SET_CURVE_POINT 0x05
+#define REQ_SET_CURVE       0x06
+
+#define REQ_GET_LATENCY     0x07
+#define REQ_GET_SCHED       0x08
+#define REQ_GET_IDLE        0x09
+#define REQ_GET_BOOT        0x0A
+#define REQ_GET_STACK       0x0B
+#define REQ_SET_DPI_XY      0x0C
+
+#define CURVE_POINTS        16
+#define CYCLES_PER_US       72
+
+#define REQ_VENDOR_OUT      0b01000000
+#define REQ_VENDOR_IN       0b11000000
+
+static void usage(void) {
+    fprintf(stderr, "Usage: ./libusb-test dpi <dpi_x> [dpi_y]\n");
+    fprintf(stderr, "       ./libusb-test mode <mode> <rest>\n");
+    fprintf(stderr, "       ./libusb-test angle <degrees>\n");
+    fprintf(stderr, "       ./libusb-test curve <step_shift> <gain_0> ... <gain_%d>\n", CURVE_POINTS - 1);
+    fprintf(stderr, "       ./libusb-test curve off\n");
+    fprintf(stderr, "       ./libusb-test latency [clear]\n");
+    fprintf(stderr, "       ./libusb-test sched [clear]\n");
+    fprintf(stderr, "       ./libusb-test idle [clear]\n");
+    fprintf(stderr, "       ./libusb-test boot\n");
+    fprintf(stderr, "       ./libusb-test stack\n");
+}
+
+static int set_dpi(libusb_device_handle *dev_handle, uint16_t dpi_x, uint16_t dpi_y) {
+
+    uint8_t data[4];
+    uint16_t applied_x, applied_y;
+    int ret;
+
+    /* one value for both axes goes through the plain request, the one
+     * 14-usbhid's libusb-test sends too */
+    if (dpi_y) {
+        ret = libusb_control_transfer(dev_handle, REQ_VENDOR_OUT, REQ_SET_DPI_XY, dpi_x, dpi_y, NULL, 0, 100);
+    }
+    else {
+        ret = libusb_control_transfer(dev_handle, REQ_VENDOR_OUT, REQ_SET_DPI, dpi_x, 0, NULL, 0, 100);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Error: `set_dpi` failed: %s\n", libusb_strerror(ret));
+        return 1;
+    }
+
+    /* the mouse applies it between two reports, give it a few frames */
+    usleep(10000);
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_IN, REQ_GET_DPI, 0, 0, data, sizeof(data), 100);
+    if (ret != sizeof(data)) {
+        fprintf(stderr, "Error: `get_dpi` failed: %s\n", ret < 0 ? libusb_strerror(ret) : "short read");
+        return 1;
+    }
+
+    applied_x = data[0] | (data[1] << 8);
+    applied_y = data[2] | (data[3] << 8);
+
+    /* the sensor works in 50 dpi steps, so a rounded value is expected */
+    printf("requested: x = %d, y = %d\n", dpi_x, dpi_y ? dpi_y : dpi_x);
+    printf("applied:   x = %d, y = %d\n", applied_x, applied_y);
+
+    return 0;
+}
+
+static int set_mode(libusb_device_handle *dev_handle, uint16_t mode, uint16_t rest) {
+
+    int ret;
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_OUT, REQ_SET_PERF_MODE, mode, rest, NULL, 0, 100);
+    if (ret < 0) {
+        fprintf(stderr, "Error: `set_perf_mode` failed: %s\n", libusb_strerror(ret));
+        return 1;
+    }
+
+    printf("Successfully sent `set_perf_mode` request: mode = %d, rest = %d\n", mode, rest);
+
+    return 0;
+}
+
+static int set_angle(libusb_device_handle *dev_handle, int16_t deg) {
+
+    int ret;
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_OUT, REQ_SET_ANGLE, (uint16_t)deg, 0, NULL, 0, 100);
+    if (ret < 0) {
+        fprintf(stderr, "Error: `set_angle` failed: %s\n", libusb_strerror(ret));
+        return 1;
+    }
+
+    printf("Successfully sent `set_angle` request: angle = %d\n", deg);
+
+    return 0;
+}
+
+/* points go to a staging table first, the final request swaps it in */
+static int set_curve(libusb_device_handle *dev_handle, int enable, uint16_t shift, char **gains) {
+
+    int ret;
+
+    for (int i = 0; enable && i < CURVE_POINTS; i++) {
+        ret = libusb_control_transfer(dev_handle, REQ_VENDOR_OUT, REQ_SET_CURVE_POINT, atoi(gains[i]), i, NULL, 0, 100);
+        if (ret < 0) {
+            fprintf(stderr, "Error: `set_curve_point` %d failed: %s\n", i, libusb_strerror(ret));
+            return 1;
+        }
+    }
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_OUT, REQ_SET_CURVE, enable, shift, NULL, 0, 100);
+    if (ret < 0) {
+        fprintf(stderr, "Error: `set_curve` failed: %s\n", libusb_strerror(ret));
+        return 1;
+    }
+
+    printf("Successfully sent `set_curve` request: enable = %d, step = %d counts/frame\n", enable, 1 << shift);
+
+    return 0;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+/* see `struct latency_stats` in the firmware */
+static int get_latency(libusb_device_handle *dev_handle, int clear) {
+
+    uint8_t data[64];
+    uint32_t count, min, max;
+    uint16_t bin_us, nbins;
+    int ret;
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_IN, REQ_GET_LATENCY, clear, 0, data, sizeof(data), 100);
+    if (ret < 16) {
+        fprintf(stderr, "Error: `get_latency` failed: %s\n", ret < 0 ? libusb_strerror(ret) : "short read");
+        return 1;
+    }
+
+    count  = get_u32(&data[0]);
+    min    = get_u32(&data[4]);
+    max    = get_u32(&data[8]);
+    bin_us = get_u16(&data[12]);
+    nbins  = get_u16(&data[14]);
+
+    if (ret < 16 + nbins * 2) {
+        fprintf(stderr, "Error: `get_latency` short read\n");
+        return 1;
+    }
+
+    printf("edges: %u\n", count);
+    if (ret >= 16 + nbins * 2 + 4) {
+        /* clicks that never made it into a report */
+        printf("dropped: %u\n", get_u32(&data[16 + nbins * 2]));
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    printf("min:   %.1f us\n", (double)min / CYCLES_PER_US);
+    printf("max:   %.1f us\n", (double)max / CYCLES_PER_US);
+
+    for (int i = 0; i < nbins; i++) {
+        uint16_t n = get_u16(&data[16 + i * 2]);
+        if (i == nbins - 1) {
+            printf(" >= %4d us : %u\n", i * bin_us, n);
+        }
+        else {
+            printf("%4d-%4d us : %u\n", i * bin_us, (i + 1) * bin_us, n);
+        }
+    }
+
+    return 0;
+}
+
+/* see `struct sched_stats` and `struct report_stats` in the firmware */
+static int get_sched(libusb_device_handle *dev_handle, int clear) {
+
+    static const char *names[] = { "usb", "stats" };
+    const int nevents = sizeof(names) / sizeof(names[0]);
+    const uint8_t *rs = NULL;
+    uint8_t data[64];
+    int ret;
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_IN, REQ_GET_SCHED, clear, 0, data, sizeof(data), 100);
+    if (ret < 0) {
+        fprintf(stderr, "Error: `get_sched` failed: %s\n", libusb_strerror(ret));
+        return 1;
+    }
+
+    printf("event        runs   max (us)  overruns\n");
+    for (int i = 0; i < nevents && (i + 1) * 12 <= ret; i++) {
+        uint32_t runs     = get_u32(&data[i * 12]);
+        uint32_t max      = get_u32(&data[i * 12 + 4]);
+        uint32_t overruns = get_u32(&data[i * 12 + 8]);
+        printf("%-6s %10u %10.1f %9u\n", names[i], runs, (double)max / CYCLES_PER_US, overruns);
+    }
+
+    /* report path, in cycles: these are a few dozen, not microseconds */
+    if (ret < nevents * 12 + 16) {
+        return 0;
+    }
+    rs = &data[nevents * 12];
+
+    uint32_t reports = get_u32(&rs[0]);
+    printf("\nreport path  %u reports\n", reports);
+    printf("stage          avg (cycles)  max (cycles)\n");
+    printf("motion         %12.1f  %12u\n",
+           reports ? (double)get_u64(&rs[8]) / reports : 0.0, get_u32(&rs[4]));
+    if (ret >= nevents * 12 + 28) {
+        printf("whole report   %12.1f  %12u\n",
+               reports ? (double)get_u64(&rs[20]) / reports : 0.0, get_u32(&rs[16]));
+    }
+
+    return 0;
+}
+
+/* see `struct idle_stats` in the firmware */
+static int get_idle(libusb_device_handle *dev_handle, int clear) {
+
+    uint8_t data[32];
+    int ret;
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_IN, REQ_GET_IDLE, clear, 0, data, sizeof(data), 100);
+    if (ret < 24) {
+        fprintf(stderr, "Error: `get_idle` failed: %s\n", ret < 0 ? libusb_strerror(ret) : "short read");
+        return 1;
+    }
+
+    printf("sleeps:   %u (%u tickless)\n", get_u32(&data[0]), get_u32(&data[4]));
+    printf("asleep:   %.3f s\n", get_u32(&data[8]) / 1e6);
+    printf("tick -> isr, after tickless sleep: %.2f us max (%u wake-ups)\n",
+           (double)get_u32(&data[16]) / CYCLES_PER_US, get_u32(&data[12]));
+    printf("tick -> isr, otherwise:            %.2f us max\n", (double)get_u32(&data[20]) / CYCLES_PER_US);
+    if (ret >= 32) {
+        /* clicks and usb don't wait for the timer wheel to catch up */
+        printf("wfi -> click/usb isr:              %.2f us max (%u wake-ups)\n",
+               (double)get_u32(&data[28]) / CYCLES_PER_US, get_u32(&data[24]));
+    }
+
+    return 0;
+}
+
+/* see `struct boot_stats` in the firmware */
+static int get_boot(libusb_device_handle *dev_handle) {
+
+    static const char *points[] = { "main()", "72MHz clock", "sensor ready", "first report" };
+    uint8_t data[20];
+    int ret;
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_IN, REQ_GET_BOOT, 0, 0, data, sizeof(data), 100);
+    if (ret != sizeof(data)) {
+        fprintf(stderr, "Error: `get_boot` failed: %s\n", ret < 0 ? libusb_strerror(ret) : "short read");
+        return 1;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        printf("reset -> %-13s %9.3f ms\n", points[i], get_u32(&data[i * 4]) / 1e3);
+    }
+    printf("startup code: %u cycles\n", get_u32(&data[16]));
+
+    return 0;
+}
+
+/* see `struct stack_stats` in the firmware */
+static int get_stack(libusb_device_handle *dev_handle) {
+
+    uint8_t data[8];
+    uint32_t reserve, used;
+    int ret;
+
+    ret = libusb_control_transfer(dev_handle, REQ_VENDOR_IN, REQ_GET_STACK, 0, 0, data, sizeof(data), 100);
+    if (ret != sizeof(data)) {
+        fprintf(stderr, "Error: `get_stack` failed: %s\n", ret < 0 ? libusb_strerror(ret) : "short read");
+        return 1;
+    }
+
+    reserve = get_u32(&data[0]);
+    used    = get_u32(&data[4]);
+
+    printf("stack: %u of %u bytes used at most%s\n", used, reserve,
+           used >= reserve ? " (reserve exhausted!)" : "");
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    libusb_context *ctx = NULL;
+    libusb_device_handle *dev_handle = NULL;
+    int ret;
+
+    if ((argc == 3 || argc == 4) && !strcmp(argv[1], "dpi")) {
+        /* handled below */
+    }
+    else if (argc == 4 && !strcmp(argv[1], "mode")) {
+        /* handled below */
+    }
+    else if (argc == 3 && !strcmp(argv[1], "angle")) {
+        /* handled below */
+    }
+    else if ((argc == 2 || argc == 3) && !strcmp(argv[1], "latency")) {
+        /* handled below */
+    }
+    else if ((argc == 2 || argc == 3) && !strcmp(argv[1], "sched")) {
+        /* handled below */
+    }
+    else if ((argc == 2 || argc == 3) && !strcmp(argv[1], "idle")) {
+        /* handled below */
+    }
+    else if (argc == 2 && !strcmp(argv[1], "boot")) {
+        /* handled below */
+    }
+    else if (argc == 2 && !strcmp(argv[1], "stack")) {
+        /* handled below */
+    }
+    else if (argc >= 3 && !strcmp(argv[1], "curve") && ((argc == 3 && !strcmp(argv[2], "off")) || argc == 3 + CURVE_POINTS)) {
+        /* handled below */
+    }
+    else {
+        usage();
+        return 1;
+    }
+
+    ret = libusb_init_context(&ctx, NULL, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to initialize libusb\n");
+        return 1;
+    }
+
+    dev_handle = libusb_open_device_with_vid_pid(ctx, 0x0483, 0x572B);
+    if (dev_handle == NULL) {
+        fprintf(stderr, "Error: cannot open device 0x0483:0x572B\n");
+        libusb_exit(ctx);
+        return 1;
+    }
+
+    if (!strcmp(argv[1], "dpi")) {
+        ret = set_dpi(dev_handle, atoi(argv[2]), argc == 4 ? atoi(argv[3]) : 0);
+    }
+    else if (!strcmp(argv[1], "mode")) {
+        ret = set_mode(dev_handle, atoi(argv[2]), atoi(argv[3]));
+    }
+    else if (!strcmp(argv[1], "angle")) {
+        ret = set_angle(dev_handle, atoi(argv[2]));
+    }
+    else if (!strcmp(argv[1], "latency")) {
+        ret = get_latency(dev_handle, argc == 3 && !strcmp(argv[2], "clear"));
+    }
+    else if (!strcmp(argv[1], "sched")) {
+        ret = get_sched(dev_handle, argc == 3 && !strcmp(argv[2], "clear"));
+    }
+    else if (!strcmp(argv[1], "idle")) {
+        ret = get_idle(dev_handle, argc == 3 && !strcmp(argv[2], "clear"));
+    }
+    else if (!strcmp(argv[1], "boot")) {
+        ret = get_boot(dev_handle);
+    }
+    else if (!strcmp(argv[1], "stack")) {
+        ret = get_stack(dev_handle);
+    }
+    else if (argc == 3) {
+        ret = set_curve(dev_handle, 0, 0, NULL);
+    }
+    else {
+        ret = set_curve(dev_handle, 1, atoi(argv[2]), &argv[3]);
+    }
+
+    libusb_close(dev_handle);
+    libusb_exit(ctx);
+
+    return ret;
+}
@@ -0,0 +1,52 @@
+/**********************************************************************************
+ ** file         : boot.c
+ ** description  : boot time milestones, counted from reset
+ **
+ **                `reset_handler()` starts the cycle counter before doing
+ **                anything else, so CYCCNT is (a few cycles short of) the
+ **                time since reset. the clock changes on the way, so every
+ **                mark converts the cycles since the previous one at the
+ **                rate they actually ran at. CYCCNT wraps after ~59s at
+ **                72MHz, which limits how far apart two marks may be.
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include "device.h"
+#include "rcc.h"
+#include "dwt.h"
+#include "boot.h"
+
+static struct boot_stats stats;
+
+/* cycle count and clock rate at the previous mark */
+static uint32_t last_cycles;
+static uint32_t last_us;
+static uint32_t last_mhz;
+
+/* each point is only recorded the first time it's reached */
+void boot_mark(enum boot_point point) {
+
+    uint32_t now = now_cycles();
+
+    if (stats.us[point]) {
+        return;
+    }
+
+    /* the first mark: everything so far ran off the reset clock */
+    if (last_mhz == 0) {
+        last_mhz = sysclk_hz / 1000000;
+        stats.startup_cycles = now;
+    }
+
+    last_us     += (now - last_cycles) / last_mhz;
+    last_cycles  = now;
+    last_mhz     = sysclk_hz / 1000000;
+
+    stats.us[point] = last_us;
+
+}
+
+void boot_get(struct boot_stats *out) {
+    *out = stats;
+}
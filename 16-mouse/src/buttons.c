@@ -0,0 +1,377 @@
+/**********************************************************************************
+ ** file         : buttons.c
+ ** description  : SPDT 0-latency debounce logic (SR-Latch emulation), for any
+ **                number of buttons on any EXTI lines.
+ **
+ **                only one pin of each pair is unmasked at a time. the first
+ **                falling edge on it flips the state and hands over to the
+ **                other pin, so the contact bounce that follows is never seen.
+ **
+ **                with BUTTONS_DMA, the same latch runs over sampled pin
+ **                levels instead: a released button waits for NO to read
+ **                low, a pressed one for NC.
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "device.h"
+#include "utils.h"
+#include "dwt.h"
+#include "irq.h"
+#include "sched.h"
+#include "buttons.h"
+
+/* board layout: index = bit in the hid report */
+static const struct button buttons[] = {
+    /* left:  PA9 (NO), PA10 (NC) */
+    { .no_port = GPIOA, .no_pin = 9, .nc_port = GPIOA, .nc_pin = 10 },
+    /* right: PA8 (NO), PB12 (NC) */
+    { .no_port = GPIOA, .no_pin = 8, .nc_port = GPIOB, .nc_pin = 12 },
+    /* more buttons go here, with BUTTON_COUNT bumped to match. hid order is
+     * left, right, middle, back, forward, e.g.:
+     *   { .no_port = GPIOB, .no_pin = 13, .nc_port = GPIOB, .nc_pin = 14 },
+     *   { .no_port = GPIOB, .no_pin = 15, .nc_port = GPIOA, .nc_pin = 15 },
+     *   { .no_port = GPIOB, .no_pin = 0,  .nc_port = GPIOB, .nc_pin = 1  },
+     */
+};
+
+_Static_assert(ARR_SIZE(buttons) == BUTTON_COUNT, "BUTTON_COUNT doesn't match the button table");
+
+/* per-EXTI-line action, built from the table by `buttons_init()` so the
+ * ISRs only do a lookup: which line to hand over to, and what to do with
+ * which state bit */
+struct exti_action {
+    uint16_t partner;   /* EXTI bit of the other pin of the pair */
+    uint8_t  bit;       /* state bit of the button */
+    uint8_t  press;     /* 1: NO pin, 0: NC pin */
+};
+
+#if !BUTTONS_DMA
+static struct exti_action exti_actions[16];
+#endif
+
+/* all EXTI lines owned by the table (DMA mode: all sample bits) */
+static uint32_t button_lines;
+
+/* bit i: button i is down */
+static volatile uint8_t button_state;
+
+_Static_assert((BUTTON_QUEUE_SIZE & (BUTTON_QUEUE_SIZE - 1)) == 0, "BUTTON_QUEUE_SIZE must be a power of 2");
+
+/* every state change, in order, so a press and release within one poll
+ * interval still make it to the host as two reports.
+ * single producer (the EXTI ISRs, which share IRQ_PRIO_BUTTONS and so can't
+ * preempt each other, or the DMA ISR), single consumer (the report path):
+ * each index is only ever written by one side, no locking needed */
+static volatile struct button_event button_queue[BUTTON_QUEUE_SIZE];
+static volatile uint8_t queue_head;     /* written by the ISRs */
+static volatile uint8_t queue_tail;     /* written by the report path */
+static volatile uint32_t queue_dropped;     /* only ever counts up */
+
+static button_callback button_cb;
+
+static void button_pin_setup(GPIO_T *port, uint8_t pin) {
+
+    volatile uint32_t *cr = (pin < 8) ? &port->CRL : &port->CRH;
+    uint32_t shft = (pin % 8) * 4;
+
+    /* input with pull-up */
+    *cr = (*cr & ~(0b1111 << shft)) | (GPIO_CNFMODE_INPUT_PUPD << shft);
+    port->ODR |= (1 << pin);
+
+}
+
+#if !BUTTONS_DMA
+
+static void button_exti_setup(GPIO_T *port, uint8_t pin) {
+
+    /* route EXTI line `pin` to this port: 0 = PA, 1 = PB, ... (0x400 apart) */
+    uint32_t port_code = ((uint32_t)port - (uint32_t)GPIOA) >> 10;
+    uint32_t shft = (pin % 4) * 4;
+    AFIO->EXTICR[pin / 4] = (AFIO->EXTICR[pin / 4] & ~(0b1111 << shft)) | (port_code << shft);
+
+    /* falling edge: the common terminal pulling the pin low */
+    EXTI->FTSR |= (1 << pin);
+
+    /* EXTI0-4 have their own vectors, 5-9 and 10-15 share one each */
+    uint32_t irq = (pin < 5)  ? (NVIC_EXTI0_IRQ + pin)
+                 : (pin < 10) ? NVIC_EXTI9_5_IRQ
+                 :              NVIC_EXTI15_10_IRQ;
+    irq_set_priority(irq, IRQ_PRIO_BUTTONS);
+    irq_enable(irq);
+
+}
+
+#else
+
+/* DMA mode: one sample is GPIOA->IDR in the low half, GPIOB->IDR in the high */
+static uint32_t sample_bit(GPIO_T *port, uint8_t pin) {
+    return (port == GPIOB) ? (1 << (pin + 16)) : (1 << pin);
+}
+
+/* ring buffers, one per port. DMA fills them in lockstep, each half is one
+ * batch: HT means the first half is complete, TC the second */
+static volatile uint16_t samples_a[2 * BUTTONS_DMA_BATCH];
+static volatile uint16_t samples_b[2 * BUTTONS_DMA_BATCH];
+
+/* per button, from the table */
+static uint32_t sample_no[BUTTON_COUNT];
+static uint32_t sample_nc[BUTTON_COUNT];
+
+/* last sample that was looked at, only changes need the full check */
+static uint32_t sample_last;
+
+#define SAMPLE_CYCLES   (72000000 / BUTTONS_DMA_RATE_HZ)
+
+/* TIM3 runs at 72MHz (APB1 x2). its update event requests DMA1 channel 3,
+ * which copies GPIOA->IDR. CC1 matches one tick later and requests
+ * channel 6, which copies GPIOB->IDR. channel 6 always finishes last, so
+ * its HT/TC interrupt means both halves are complete (rm0008 13.3.7) */
+static void buttons_dma_setup(void) {
+
+    RCC->AHBENR  |= RCC_AHBENR_DMA1EN_;
+    RCC->APB1ENR |= RCC_APB1ENR_TIM3EN_;
+
+    uint32_t ccr = DMA_CCR_PSIZE_16 | DMA_CCR_MSIZE_16 | DMA_CCR_MINC_
+                 | DMA_CCR_CIRC_    | DMA_CCR_PL_VERYHIGH;
+
+    DMA1->CH[2].CPAR  = (uint32_t)&GPIOA->IDR;
+    DMA1->CH[2].CMAR  = (uint32_t)samples_a;
+    DMA1->CH[2].CNDTR = 2 * BUTTONS_DMA_BATCH;
+    DMA1->CH[2].CCR   = ccr | DMA_CCR_EN_;
+
+    DMA1->CH[5].CPAR  = (uint32_t)&GPIOB->IDR;
+    DMA1->CH[5].CMAR  = (uint32_t)samples_b;
+    DMA1->CH[5].CNDTR = 2 * BUTTONS_DMA_BATCH;
+    DMA1->CH[5].CCR   = ccr | DMA_CCR_HTIE_ | DMA_CCR_TCIE_ | DMA_CCR_EN_;
+
+    irq_set_priority(NVIC_DMA1_CHANNEL6_IRQ, IRQ_PRIO_BUTTONS);
+    irq_enable(NVIC_DMA1_CHANNEL6_IRQ);
+
+    TIM3->PSC  = 0;
+    TIM3->ARR  = SAMPLE_CYCLES - 1;
+    TIM3->CCR1 = 1;
+    TIM3->EGR |= TIM_EGR_UG_;
+    TIM3->DIER |= TIM_DIER_UDE_ | TIM_DIER_CC1DE_;
+    TIM3->CR1  |= TIM_CR1_CEN_;
+
+}
+
+#endif
+
+/* assumes the GPIO ports and AFIO are already clocked */
+void buttons_init(void) {
+
+    button_lines = 0;
+    button_state = 0;
+    queue_head   = 0;
+    queue_tail   = 0;
+
+    for (uint8_t i = 0; i < ARR_SIZE(buttons); i++) {
+
+        const struct button *b = &buttons[i];
+
+        button_pin_setup(b->no_port, b->no_pin);
+        button_pin_setup(b->nc_port, b->nc_pin);
+
+        #if !BUTTONS_DMA
+
+        button_exti_setup(b->no_port, b->no_pin);
+        button_exti_setup(b->nc_port, b->nc_pin);
+
+        exti_actions[b->no_pin] = (struct exti_action){ .partner = (1 << b->nc_pin), .bit = i, .press = 1 };
+        exti_actions[b->nc_pin] = (struct exti_action){ .partner = (1 << b->no_pin), .bit = i, .press = 0 };
+
+        /* start released: wait on NO, keep NC masked */
+        EXTI->IMR |=  (1 << b->no_pin);
+        EXTI->IMR &= ~(1 << b->nc_pin);
+
+        button_lines |= (1 << b->no_pin) | (1 << b->nc_pin);
+
+        #else
+
+        sample_no[i] = sample_bit(b->no_port, b->no_pin);
+        sample_nc[i] = sample_bit(b->nc_port, b->nc_pin);
+        button_lines |= sample_no[i] | sample_nc[i];
+
+        #endif
+
+    }
+
+    #if !BUTTONS_DMA
+
+    /* clear any potential spurious pending bits */
+    EXTI->PR = button_lines;
+
+    #else
+
+    /* all pulled up = all released */
+    sample_last = button_lines;
+    buttons_dma_setup();
+
+    #endif
+
+}
+
+uint8_t buttons_get(void) {
+    return button_state;
+}
+
+/* oldest state change not yet reported, returns 0 if there's none.
+ * when the queue is empty, `buttons_get()` is what the host last saw */
+int buttons_pop(struct button_event *ev) {
+
+    uint8_t tail = queue_tail;
+
+    if (tail == queue_head) {
+        return 0;
+    }
+
+    ev->state = button_queue[tail].state;
+    ev->stamp = button_queue[tail].stamp;
+    queue_tail = (tail + 1) & (BUTTON_QUEUE_SIZE - 1);
+
+    return 1;
+
+}
+
+/* state changes lost to a full queue since boot */
+uint32_t buttons_dropped(void) {
+    return queue_dropped;
+}
+
+void buttons_register_callback(button_callback cb) {
+    button_cb = cb;
+}
+
+/* called from the ISRs only. on overflow the intermediate state is lost,
+ * but `button_state` stays right, so the host still ends up in sync */
+RAMFUNC static void buttons_push(uint8_t state, uint32_t stamp) {
+
+    uint8_t head = queue_head;
+    uint8_t next = (head + 1) & (BUTTON_QUEUE_SIZE - 1);
+
+    if (next == queue_tail) {
+        queue_dropped++;
+        return;
+    }
+
+    /* slot first, then publish it */
+    button_queue[head].state = state;
+    button_queue[head].stamp = stamp;
+    queue_head = next;
+
+    if (button_cb) {
+        struct button_event ev = { .state = state, .stamp = stamp };
+        button_cb(&ev, head == queue_tail);
+    }
+
+}
+
+#if !BUTTONS_DMA
+
+/* same amount of work per edge whatever the table looks like.
+ * the masked pin of a pair can still latch a pending bit while it bounces,
+ * hence only unmasked lines are looked at, and both are cleared on a flip */
+RAMFUNC static void buttons_handle(uint32_t lines) {
+
+    /* as close to the edge as we can get: ISR entry + a few cycles */
+    uint32_t stamp   = now_cycles();
+    uint32_t pending = EXTI->PR & EXTI->IMR & button_lines & lines;
+
+    sched_woken(stamp);
+
+    while (pending) {
+
+        uint32_t line = __builtin_ctz(pending);
+        const struct exti_action *a = &exti_actions[line];
+        pending &= pending - 1;
+
+        /* disable this pin, enable the other one of the pair */
+        EXTI->IMR = (EXTI->IMR & ~(1 << line)) | a->partner;
+
+        /* clear pending bits */
+        EXTI->PR = (1 << line) | a->partner;
+
+        if (a->press) {
+            button_state |=  (1 << a->bit);
+        }
+        else {
+            button_state &= ~(1 << a->bit);
+        }
+
+        buttons_push(button_state, stamp);
+
+    }
+
+}
+
+RAMFUNC void exti0_isr(void)     { buttons_handle(EXTI0); }
+RAMFUNC void exti1_isr(void)     { buttons_handle(EXTI1); }
+RAMFUNC void exti2_isr(void)     { buttons_handle(EXTI2); }
+RAMFUNC void exti3_isr(void)     { buttons_handle(EXTI3); }
+RAMFUNC void exti4_isr(void)     { buttons_handle(EXTI4); }
+RAMFUNC void exti9_5_isr(void)   { buttons_handle(EXTI5  | EXTI6  | EXTI7  | EXTI8  | EXTI9);  }
+RAMFUNC void exti15_10_isr(void) { buttons_handle(EXTI10 | EXTI11 | EXTI12 | EXTI13 | EXTI14 | EXTI15); }
+
+#else
+
+/* runs the latch over one batch. most samples are identical to the one
+ * before and cost a compare; a change costs one check per button. state
+ * changes are stamped with the time their sample was taken, counted back
+ * from now (the batch's last sample was just written) */
+RAMFUNC static void buttons_handle_batch(uint32_t first) {
+
+    uint32_t now = now_cycles();
+
+    for (uint32_t k = 0; k < BUTTONS_DMA_BATCH; k++) {
+
+        uint32_t word = (samples_a[first + k] | ((uint32_t)samples_b[first + k] << 16)) & button_lines;
+
+        if (word == sample_last) {
+            continue;
+        }
+        sample_last = word;
+
+        uint32_t stamp = now - (BUTTONS_DMA_BATCH - 1 - k) * SAMPLE_CYCLES;
+
+        for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+
+            uint8_t bit = (1 << i);
+
+            if (!(button_state & bit) && !(word & sample_no[i])) {
+                button_state |= bit;
+                buttons_push(button_state, stamp);
+            }
+            else if ((button_state & bit) && !(word & sample_nc[i])) {
+                button_state &= ~bit;
+                buttons_push(button_state, stamp);
+            }
+
+        }
+
+    }
+
+}
+
+RAMFUNC void dma1_channel6_isr(void) {
+
+    uint32_t flags = DMA1->ISR;
+
+    sched_woken(now_cycles());
+
+    /* both can be set if we fell a whole half behind, oldest first */
+    if (flags & DMA_ISR_HTIF(6)) {
+        DMA1->IFCR = DMA_ISR_HTIF(6);
+        buttons_handle_batch(0);
+    }
+
+    if (flags & DMA_ISR_TCIF(6)) {
+        DMA1->IFCR = DMA_ISR_TCIF(6);
+        buttons_handle_batch(BUTTONS_DMA_BATCH);
+    }
+
+}
+
+#endif
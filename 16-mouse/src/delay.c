@@ -1,26 +1,81 @@
 /**********************************************************************************
  ** file         : delay.c
- ** description  : 
+ ** description  : 64-bit µs timebase on TIM2, and delays built on it
  **
  **
  **********************************************************************************/
 
 #include <stdint.h>
 #include "device.h"
+#include "irq.h"
 #include "delay.h"
 
-/* assumes free-running 1MHz tim_clk 
+/* TIM2 runs free at 1MHz over its full 16-bit range and is never written
+ * after init, so anyone may take differences of TIM2->CNT. the update
+ * interrupt counts wraps, which gives the upper bits: 2^32 wraps of 65.536ms
+ * is ~8900 years, plenty for a 64-bit µs clock.
  */
-void delay_ms(uint32_t ms) {
-    while (ms--) {
-        TIM2->CNT = 0;
-        while (TIM2->CNT < 1000);
-    }
+static volatile uint32_t time_overflows;
+
+void tim2_isr(void) {
+    TIM2->SR = ~TIM_SR_UIF_;
+    time_overflows++;
+}
+
+void timebase_init(void) {
+
+    /* 72MHz / 72 = 1MHz */
+    TIM2->PSC = 71;
+    TIM2->ARR = 0xffff;
+
+    /* generate update event: apply PSC. with URS set the UG doesn't raise
+     * UIF, so only real wraps count */
+    TIM2->CR1 |= TIM_CR1_URS_;
+    TIM2->EGR |= TIM_EGR_UG_;
+    TIM2->SR = 0;
+
+    TIM2->DIER |= TIM_DIER_UIE_;
+    irq_set_priority(NVIC_TIM2_IRQ, IRQ_PRIO_TIMEBASE);
+    irq_enable(NVIC_TIM2_IRQ);
+
+    /* enable TIM2 counter */
+    TIM2->CR1 |= TIM_CR1_CEN_;
+
 }
 
-/* assumes free-running 1MHz tim_clk 
+/* lock-free: take the wrap count, then the counter, and retry if the ISR
+ * bumped the count in between.
+ *
+ * if we run with interrupts masked (or above TIM2's priority) the ISR can't
+ * run, but UIF still tells us a wrap happened that isn't counted yet. CNT is
+ * re-read after seeing UIF so it's guaranteed to be past that wrap. this
+ * covers one pending wrap, i.e. callers must not stay masked for > 65ms.
  */
+uint64_t time_us(void) {
+
+    uint32_t start, hi, lo;
+
+    do {
+        start = time_overflows;
+        hi = start;
+        lo = TIM2->CNT;
+        if (TIM2->SR & TIM_SR_UIF_) {
+            lo = TIM2->CNT;
+            hi++;
+        }
+    } while (start != time_overflows);
+
+    return ((uint64_t)hi << 16) | lo;
+}
+
+void delay_until(uint64_t deadline) {
+    while (time_us() < deadline);
+}
+
+void delay_ms(uint32_t ms) {
+    delay_until(time_us() + (uint64_t)ms * 1000);
+}
+
 void delay_us(uint16_t us) {
-    TIM2->CNT = 0;
-    while (TIM2->CNT < us);
+    delay_until(time_us() + us);
 }
@@ -0,0 +1,60 @@
+/**********************************************************************************
+ ** file         : irq.c
+ ** description  : vector table in RAM, runtime ISR binding
+ **
+ **                the flash table (startup.c) is a const array of weak
+ **                aliases: which function handles what is fixed at link
+ **                time. a copy in RAM, pointed at by VTOR, can be changed
+ **                on the fly, e.g. to swap in a specialized ISR for a mode
+ **                instead of branching on the mode inside one ISR.
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "device.h"
+#include "utils.h"
+#include "irq.h"
+
+#define VECTOR_COUNT    (16 + NVIC_IRQ_COUNT)
+
+extern const uint32_t vector_table[];
+
+/* VTOR wants the table aligned to its size rounded up to a power of 2:
+ * 84 vectors = 336 bytes -> 512. the linker script puts the section at the
+ * start of RAM, so this doesn't cost any padding */
+static irq_handler ram_vectors[VECTOR_COUNT]
+__attribute__ ((aligned(512), section(".ram_vectors")));
+
+_Static_assert(VECTOR_COUNT * 4 <= 512, "ram_vectors alignment too small");
+
+/* call before enabling any interrupt. exceptions taken in between would
+ * still find the same handlers, but bindings only work after this */
+void irq_vectors_to_ram(void) {
+
+    memcpy(ram_vectors, vector_table, sizeof(ram_vectors));
+
+    /* make sure the table is written before the core may fetch from it */
+    __asm__ volatile ("dsb" ::: "memory");
+    SCB->VTOR = (uint32_t)ram_vectors;
+    __asm__ volatile ("dsb\n\tisb" ::: "memory");
+
+}
+
+/* point `irq` (NVIC number, or IRQ_SYSTICK / IRQ_PENDSV) at `handler`,
+ * returns the old one, or NULL if the table isn't in RAM. (NMI is -14, the
+ * stack pointer and reset entries can't be bound.) a vector is one
+ * word, so the swap is atomic: an interrupt gets either handler */
+irq_handler irq_bind(int32_t irq, irq_handler handler) {
+
+    if (SCB->VTOR != (uint32_t)ram_vectors || irq < -14 || irq >= NVIC_IRQ_COUNT) {
+        return NULL;
+    }
+
+    irq_handler old = ram_vectors[16 + irq];
+    ram_vectors[16 + irq] = handler;
+    __asm__ volatile ("dsb" ::: "memory");
+
+    return old;
+
+}
@@ -0,0 +1,60 @@
+/**********************************************************************************
+ ** file         : latency.c
+ ** description  : times button edges against the DWT cycle counter, from the
+ **                EXTI ISR to the CTR IN of the report that carried them.
+ **
+ **                the end point is when the firmware sees the CTR, not the
+ **                moment the host ACK'd, so the numbers are slightly high.
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include "device.h"
+#include "dwt.h"
+#include "latency.h"
+
+static struct latency_stats stats;
+
+/* CYCCNT must already run, see `dwt_init()` */
+void latency_init(void) {
+    latency_reset();
+}
+
+/* once per change: the caller knows which reports repeat one */
+void latency_record(uint32_t start) {
+
+    uint32_t cycles = now_cycles() - start;
+    uint32_t bin    = cycles / (LATENCY_BIN_US * (sysclk_hz / 1000000));
+
+    if (bin >= LATENCY_BINS) {
+        bin = LATENCY_BINS - 1;
+    }
+
+    /* saturate rather than wrap */
+    if (stats.bins[bin] != 0xffff) {
+        stats.bins[bin]++;
+    }
+
+    if (cycles < stats.min_cycles) stats.min_cycles = cycles;
+    if (cycles > stats.max_cycles) stats.max_cycles = cycles;
+    stats.count++;
+
+}
+
+void latency_get(struct latency_stats *out) {
+    *out = stats;
+}
+
+void latency_reset(void) {
+
+    for (uint8_t i = 0; i < LATENCY_BINS; i++) {
+        stats.bins[i] = 0;
+    }
+
+    stats.count      = 0;
+    stats.min_cycles = 0xffffffff;
+    stats.max_cycles = 0;
+    stats.bin_us     = LATENCY_BIN_US;
+    stats.nbins      = LATENCY_BINS;
+
+}
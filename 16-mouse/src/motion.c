@@ -0,0 +1,216 @@
+/**********************************************************************************
+ ** file         : motion.c
+ ** description  : motion transform stage, runs on every burst before the report
+ **                is written, so it has to stay cheap: a handful of multiplies
+ **                and no divides, no floats, no loops.
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include "motion.h"
+
+#define Q15_SHIFT   15
+#define Q15_ONE     (1 << Q15_SHIFT)
+#define Q15_HALF    (1 << (Q15_SHIFT - 1))
+
+/* round(sin(deg) * 2^15) for 0..90 degrees, the other quadrants are folded
+ * onto this one. sin(90) = 2^15 doesn't fit an int16, hence unsigned */
+static const uint16_t sin_q15[91] = {
+        0,   572,  1144,  1715,  2286,  2856,  3425,  3993,
+     4560,  5126,  5690,  6252,  6813,  7371,  7927,  8481,
+     9032,  9580, 10126, 10668, 11207, 11743, 12275, 12803,
+    13328, 13848, 14365, 14876, 15384, 15886, 16384, 16877,
+    17364, 17847, 18324, 18795, 19261, 19720, 20174, 20622,
+    21063, 21498, 21926, 22348, 22763, 23170, 23571, 23965,
+    24351, 24730, 25102, 25466, 25822, 26170, 26510, 26842,
+    27166, 27482, 27789, 28088, 28378, 28660, 28932, 29197,
+    29452, 29698, 29935, 30163, 30382, 30592, 30792, 30983,
+    31164, 31336, 31499, 31651, 31795, 31928, 32052, 32166,
+    32270, 32365, 32449, 32524, 32588, 32643, 32688, 32723,
+    32748, 32763, 32768,
+};
+
+/* rotation state. the remainders hold what was rounded off the last output
+ * (in Q15), and get added back on the next one. without them, a slow
+ * diagonal move of 1 count per frame would round the same way every frame
+ * and drift off-angle, or never move the minor axis at all.
+ */
+static int16_t motion_angle;
+static int32_t rot_cos = Q15_ONE;
+static int32_t rot_sin = 0;
+static int32_t rot_rem_x;
+static int32_t rot_rem_y;
+
+/* sensitivity curve. the host uploads into the staging table point by
+ * point and `motion_curve_commit()` copies it over in one go, so the report
+ * path never runs on a half-uploaded curve */
+static uint16_t curve_staging[MOTION_CURVE_POINTS];
+static uint16_t curve_gain[MOTION_CURVE_POINTS];
+static uint8_t  curve_shift;
+static uint8_t  curve_enabled;
+static int32_t  curve_rem_x;
+static int32_t  curve_rem_y;
+
+/* sin(deg) in Q15, deg in [0, 360) */
+static int32_t q15_sin(uint16_t deg) {
+
+    if (deg <= 90)  return  sin_q15[deg];
+    if (deg <= 180) return  sin_q15[180 - deg];
+    if (deg <= 270) return -sin_q15[deg - 180];
+    return -sin_q15[360 - deg];
+
+}
+
+static int16_t clamp16(int32_t v) {
+
+    if (v >  INT16_MAX) v = INT16_MAX;
+    if (v < -INT16_MAX) v = -INT16_MAX;  /* report's LOGICAL_MINIMUM is -32767 */
+    return v;
+
+}
+
+/* not on the report path: the lookups and the modulo happen once, here */
+void motion_set_angle(int16_t deg) {
+
+    int16_t wrapped = deg % 360;
+    if (wrapped < 0) wrapped += 360;
+
+    rot_sin = q15_sin(wrapped);
+    rot_cos = q15_sin((wrapped + 90) % 360);
+
+    /* leftovers were for the old angle */
+    rot_rem_x = 0;
+    rot_rem_y = 0;
+
+    /* report back in (-180, 180] */
+    motion_angle = (wrapped > 180) ? (wrapped - 360) : wrapped;
+
+}
+
+int16_t motion_get_angle(void) {
+    return motion_angle;
+}
+
+/* rotate in Q15 and round to nearest, keeping the rounding error for the
+ * next frame. |dx*cos - dy*sin| <= 2^15 * 2^15 * sqrt(2), so the
+ * accumulator fits in 32 bits. on the M3 this is 4 single-cycle MULs plus
+ * adds and shifts, the only branches are in the (rarely taken) clamps.
+ */
+static void motion_rotate(int16_t *dx, int16_t *dy) {
+
+    int32_t x = *dx;
+    int32_t y = *dy;
+    int32_t acc_x, acc_y, out_x, out_y;
+
+    acc_x = x * rot_cos - y * rot_sin + rot_rem_x;
+    acc_y = x * rot_sin + y * rot_cos + rot_rem_y;
+
+    /* arithmetic shift floors, so bias by half first to round */
+    out_x = (acc_x + Q15_HALF) >> Q15_SHIFT;
+    out_y = (acc_y + Q15_HALF) >> Q15_SHIFT;
+
+    /* always within +-2^14: whatever clamping drops below is not carried */
+    rot_rem_x = acc_x - out_x * Q15_ONE;
+    rot_rem_y = acc_y - out_y * Q15_ONE;
+
+    *dx = clamp16(out_x);
+    *dy = clamp16(out_y);
+
+}
+
+int motion_curve_set_point(uint8_t idx, uint16_t gain) {
+
+    if (idx >= MOTION_CURVE_POINTS) {
+        return -1;
+    }
+
+    curve_staging[idx] = gain;
+    return 0;
+
+}
+
+/* make the staged curve live, or turn the stage off (gain 1.0 everywhere) */
+int motion_curve_commit(uint8_t enable, uint8_t step_shift) {
+
+    if (step_shift > MOTION_CURVE_SHIFT_MAX) {
+        return -1;
+    }
+
+    for (uint8_t i = 0; i < MOTION_CURVE_POINTS; i++) {
+        curve_gain[i] = curve_staging[i];
+    }
+
+    curve_shift   = step_shift;
+    curve_enabled = enable;
+    curve_rem_x   = 0;
+    curve_rem_y   = 0;
+
+    return 0;
+
+}
+
+/* speed from max + min/2, within ~12% of the true magnitude. that's plenty
+ * to pick a gain, and there's no sqrt */
+static uint32_t motion_speed(int32_t x, int32_t y) {
+
+    uint32_t ax = (x < 0) ? -x : x;
+    uint32_t ay = (y < 0) ? -y : y;
+    uint32_t hi = (ax > ay) ? ax : ay;
+    uint32_t lo = (ax > ay) ? ay : ax;
+
+    return hi + (lo >> 1);
+
+}
+
+/* constant time regardless of speed or table contents: clamp the index,
+ * one interpolation, two multiplies. Q8.8 rounding error is carried to the
+ * next frame the same way the rotation does it.
+ */
+static void motion_curve(int16_t *dx, int16_t *dy) {
+
+    int32_t x = *dx;
+    int32_t y = *dy;
+    int32_t acc_x, acc_y, out_x, out_y;
+    int32_t g0, g1, gain;
+    uint32_t speed, idx, frac;
+
+    speed = motion_speed(x, y);
+    idx   = speed >> curve_shift;
+    frac  = speed & ((1 << curve_shift) - 1);
+
+    /* beyond the table: flat at the last point */
+    if (idx >= MOTION_CURVE_POINTS - 1) {
+        idx  = MOTION_CURVE_POINTS - 1;
+        frac = 0;
+    }
+
+    g0   = curve_gain[idx];
+    g1   = curve_gain[idx + (frac != 0)];
+    gain = g0 + (((g1 - g0) * (int32_t)frac) >> curve_shift);
+
+    /* |x| <= 2^15 and gain < 2^16, so this fits */
+    acc_x = x * gain + curve_rem_x;
+    acc_y = y * gain + curve_rem_y;
+
+    out_x = (acc_x + (MOTION_GAIN_ONE / 2)) >> 8;
+    out_y = (acc_y + (MOTION_GAIN_ONE / 2)) >> 8;
+
+    curve_rem_x = acc_x - out_x * MOTION_GAIN_ONE;
+    curve_rem_y = acc_y - out_y * MOTION_GAIN_ONE;
+
+    *dx = clamp16(out_x);
+    *dy = clamp16(out_y);
+
+}
+
+/* entry point for the report path. rotation first, so the curve sees the
+ * speed the user actually moved at (rotation doesn't change magnitude) */
+void motion_apply(int16_t *dx, int16_t *dy) {
+
+    motion_rotate(dx, dy);
+
+    if (curve_enabled) {
+        motion_curve(dx, dy);
+    }
+
+}
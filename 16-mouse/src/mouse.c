@@ -11,19 +11,124 @@
 #include "rcc.h"
 #include "gpio.h"
 #include "spim.h"
+#include "delay.h"
+#include "dwt.h"
 #include "paw3395.h"
+#include "motion.h"
+#include "buttons.h"
+#include "latency.h"
+#include "timer.h"
+#include "sched.h"
+#include "irq.h"
+#include "boot.h"
+#include "stack.h"
 #include "utils.h"
 #include "usb.h"
 #include "hid.h"
 #include "SEGGER_RTT.h"
 
-/* global l/r click states */
-volatile uint8_t l_click = 0;
-volatile uint8_t r_click = 0;
+/* APB2 clock after `set_sysclk_72mhz()`, feeds SPI1 */
+#define PCLK2_HZ 72000000
+
+/* scroll wheel encoder edges per detent (encoder mode 3 counts all 4 edges of
+ * a quadrature cycle; most mouse wheels do one cycle per detent) */
+#define WHEEL_COUNTS_PER_DETENT     4
+
+/* report layout: 16-bit X/Y/wheel, or 8-bit for 3 bytes less per report.
+ * with 8 bits, anything past +-127 in a frame is carried to the next one,
+ * so nothing is lost, just spread out. button count is BUTTON_COUNT
+ * (buttons.h). the descriptor, `struct hid_mouse_report` and the ep1
+ * wMaxPacketSize below are all derived from these */
+#define REPORT_DELTA_BITS           16
+
+#if REPORT_DELTA_BITS == 16
+typedef int16_t report_delta_t;
+#define REPORT_DELTA_MAX            32767
+#define HID_LOGICAL_DELTA           0x16, 0x01, 0x80, 0x26, 0xff, 0x7f  /* LOGICAL_MINIMUM (-32767), LOGICAL_MAXIMUM (32767) */
+#elif REPORT_DELTA_BITS == 8
+typedef int8_t  report_delta_t;
+#define REPORT_DELTA_MAX            127
+#define HID_LOGICAL_DELTA           0x15, 0x81, 0x25, 0x7f              /* LOGICAL_MINIMUM (-127), LOGICAL_MAXIMUM (127) */
+#else
+#error "REPORT_DELTA_BITS must be 8 or 16"
+#endif
+
+/* buttons are packed into one byte, the rest of it is padding */
+_Static_assert(BUTTON_COUNT >= 1 && BUTTON_COUNT <= 8, "BUTTON_COUNT must fit the buttons byte");
+#define REPORT_BUTTON_PADDING       (8 - BUTTON_COUNT)
+
+/* vendor-specific control requests (bmRequestType: vendor, device) */
+#define MOUSE_REQ_SET_DPI           0x01    /* OUT: wValue = dpi, both axes (wIndex unused, 14-usbhid's tool sends bInterval) */
+#define MOUSE_REQ_SET_PERF_MODE     0x02    /* OUT: wValue = enum paw_mode, wIndex = rest on/off */
+#define MOUSE_REQ_GET_DPI           0x03    /* IN:  4 bytes, applied X dpi, Y dpi (little-endian) */
+#define MOUSE_REQ_SET_ANGLE         0x04    /* OUT: wValue = (int16_t) rotation in degrees */
+#define MOUSE_REQ_SET_CURVE_POINT   0x05    /* OUT: wIndex = point, wValue = Q8.8 gain (staged) */
+#define MOUSE_REQ_SET_CURVE         0x06    /* OUT: wValue = enable, wIndex = speed step shift (commits) */
+#define MOUSE_REQ_GET_LATENCY       0x07    /* IN:  struct latency_stats, wValue = 1 to clear after */
+#define MOUSE_REQ_GET_SCHED         0x08    /* IN:  struct sched_stats per event, then struct report_stats, wValue = 1 to clear after */
+#define MOUSE_REQ_GET_IDLE          0x09    /* IN:  struct idle_stats, wValue = 1 to clear after */
+#define MOUSE_REQ_GET_BOOT          0x0A    /* IN:  struct boot_stats */
+#define MOUSE_REQ_GET_STACK         0x0B    /* IN:  struct stack_stats */
+#define MOUSE_REQ_SET_DPI_XY        0x0C    /* OUT: wValue = X dpi, wIndex = Y dpi */
 
 /* our handle (ptr) to the device alloc'd in `usb.c` */
 static usb_device *usb_dev;
 
+/* resolution requested over ep0, applied by the report path between bursts */
+static uint16_t pending_dpi_x;
+static uint16_t pending_dpi_y;
+static uint8_t  pending_dpi;
+
+/* ep1's buffer holds a report carrying a button change that hasn't been
+ * collected yet. patching that one would overwrite the change. its latency
+ * is recorded from `report_stamp` once the report is collected */
+static volatile uint8_t  report_has_change;
+static volatile uint32_t report_stamp;
+
+/* the oldest queued change was patched into the report that's out now, so
+ * it's already delivered: the next report pops it and moves on */
+static volatile uint8_t  queued_sent;
+
+/* cycles spent in the report path, sent after the per-event stats of
+ * `MOUSE_REQ_GET_SCHED`. the totals are for the averages. `report_*` is all
+ * of `send_hid_report()`: sensor burst, motion stage and PMA copy, which is
+ * what RAMFUNCS=0 vs 1 should show up in */
+struct report_stats {
+    uint32_t reports;
+    uint32_t motion_max_cycles;
+    uint64_t motion_cycles;
+    uint32_t report_max_cycles;
+    uint64_t report_cycles;
+} __attribute__((packed));
+
+static struct report_stats report_stats;
+
+/* ep0 IN reply buffers for the vendor GET requests (latency, sched, idle,
+ * boot, stack). the data stage is sent after the handler returns, so they
+ * can't live on its stack */
+static struct latency_stats latency_reply;
+static uint32_t             dropped_cleared;    /* `buttons_dropped()` at the last clear */
+static struct {
+    struct sched_stats  events[SCHED_EV_COUNT];
+    struct report_stats report;
+} __attribute__((packed)) sched_reply;
+static struct idle_stats    idle_reply;
+static struct boot_stats    boot_reply;
+static struct stack_stats   stack_reply;
+
+/* wheel encoder count already reported */
+static uint16_t wheel_last;
+
+/* motion that didn't fit into the last report's X/Y fields */
+static int32_t carry_x;
+static int32_t carry_y;
+
+/* resolution multiplier feature: 0 = report detents, 1 = report raw counts */
+static struct hid_mouse_feature hid_feature;
+
+/* ep0 IN data for `MOUSE_REQ_GET_DPI` */
+static uint16_t dpi_reply[2];
+
 const struct usb_device_descriptor device_descriptor = {
     .bLength            = USB_DT_DEVICE_SIZE,
     .bDescriptorType    = USB_DT_DEVICE,
@@ -42,18 +147,34 @@ const struct usb_device_descriptor device_descriptor = {
 };
 
 struct hid_mouse_report {
-    uint8_t buttons;  
-    int16_t x;
-    int16_t y;
-    int16_t wheel;
+    uint8_t        buttons;
+    report_delta_t x;
+    report_delta_t y;
+    report_delta_t wheel;
 } __attribute__((packed));
 
-/* 7 byte report:
+/* feature report: wheel resolution multiplier, 2 bits + padding */
+struct hid_mouse_feature {
+    uint8_t multiplier;
+} __attribute__((packed));
+
+/* 7 byte report (4 with 8-bit deltas):
  * byte 0:
- *   REPORT_COUNT (2), REPORT_SIZE(1) = button 1,2 = 2 bits
+ *   REPORT_COUNT (BUTTON_COUNT), REPORT_SIZE(1) = buttons 1..BUTTON_COUNT
+ *   REPORT_COUNT (1), REPORT_SIZE(8 - BUTTON_COUNT) = padding
+ * bytes 1-4 (1-2):
+ *   REPORT_COUNT (2), REPORT_SIZE(REPORT_DELTA_BITS) = X, Y
+ * bytes 5-6 (3):
+ *   REPORT_COUNT (1), REPORT_SIZE(REPORT_DELTA_BITS) = Wheel
+ *
+ * 1 byte feature report:
+ *   REPORT_COUNT (1), REPORT_SIZE(2) = Resolution Multiplier = 2 bits
  *   REPORT_COUNT (1), REPORT_SIZE(6) = padding = 6 bits
- * bytes 1-6: 
- *   REPORT_COUNT (3), REPORT_SIZE(16) = X, Y, Wheel = 3 * 2 bytes
+ *
+ * the multiplier applies to the wheel because they share a logical
+ * collection. logical 0..1 maps to physical 1..WHEEL_COUNTS_PER_DETENT:
+ * a host that sets it to 1 gets raw encoder counts and divides them back
+ * down itself, one that doesn't know about it gets whole detents.
  */
 static const uint8_t hid_mouse_report_descriptor[] = {
     0x05, 0x01,         /* USAGE_PAGE (Generic Desktop)         */
@@ -63,24 +184,42 @@ static const uint8_t hid_mouse_report_descriptor[] = {
     0xa1, 0x00,         /*   COLLECTION (Physical)              */
     0x05, 0x09,         /*     USAGE_PAGE (Button)              */
     0x19, 0x01,         /*     USAGE_MINIMUM (Button 1)         */
-    0x29, 0x02,         /*     USAGE_MAXIMUM (Button 2)         */
+    0x29, BUTTON_COUNT, /*     USAGE_MAXIMUM (Button n)         */
     0x15, 0x00,         /*     LOGICAL_MINIMUM (0)              */
     0x25, 0x01,         /*     LOGICAL_MAXIMUM (1)              */
-    0x95, 0x02,         /*     REPORT_COUNT (2)                 */
+    0x95, BUTTON_COUNT, /*     REPORT_COUNT (n)                 */
     0x75, 0x01,         /*     REPORT_SIZE (1)                  */
     0x81, 0x02,         /*     INPUT (Data,Var,Abs)             */
+#if REPORT_BUTTON_PADDING > 0
     0x95, 0x01,         /*     REPORT_COUNT (1)                 */
-    0x75, 0x06,         /*     REPORT_SIZE (6)                  */
+    0x75, REPORT_BUTTON_PADDING, /* REPORT_SIZE (8 - n)         */
     0x81, 0x01,         /*     INPUT (Cnst,Ary,Abs)             */
+#endif
     0x05, 0x01,         /*     USAGE_PAGE (Generic Desktop)     */
     0x09, 0x30,         /*     USAGE (X)                        */
     0x09, 0x31,         /*     USAGE (Y)                        */
-    0x09, 0x38,         /*     USAGE (Wheel)                    */
-    0x16, 0x01, 0x80,   /*     LOGICAL_MINIMUM (-32767)         */
-    0x26, 0xff, 0x7f,   /*     LOGICAL_MAXIMUM (32767)          */
-    0x95, 0x03,         /*     REPORT_COUNT (3)                 */
-    0x75, 0x10,         /*     REPORT_SIZE (16)                 */
+    HID_LOGICAL_DELTA,  /*     LOGICAL_MINIMUM/MAXIMUM          */
+    0x95, 0x02,         /*     REPORT_COUNT (2)                 */
+    0x75, REPORT_DELTA_BITS, /* REPORT_SIZE                     */
     0x81, 0x06,         /*     INPUT (Data,Var,Rel)             */
+    0xa1, 0x02,         /*     COLLECTION (Logical)             */
+    0x09, 0x48,         /*       USAGE (Resolution Multiplier)  */
+    0x15, 0x00,         /*       LOGICAL_MINIMUM (0)            */
+    0x25, 0x01,         /*       LOGICAL_MAXIMUM (1)            */
+    0x35, 0x01,         /*       PHYSICAL_MINIMUM (1)           */
+    0x45, WHEEL_COUNTS_PER_DETENT, /* PHYSICAL_MAXIMUM          */
+    0x95, 0x01,         /*       REPORT_COUNT (1)               */
+    0x75, 0x02,         /*       REPORT_SIZE (2)                */
+    0xb1, 0x02,         /*       FEATURE (Data,Var,Abs)         */
+    0x75, 0x06,         /*       REPORT_SIZE (6)                */
+    0xb1, 0x01,         /*       FEATURE (Cnst,Ary,Abs)         */
+    0x35, 0x00,         /*       PHYSICAL_MINIMUM (0)           */
+    0x45, 0x00,         /*       PHYSICAL_MAXIMUM (0)           */
+    0x09, 0x38,         /*       USAGE (Wheel)                  */
+    HID_LOGICAL_DELTA,  /*       LOGICAL_MINIMUM/MAXIMUM        */
+    0x75, REPORT_DELTA_BITS, /* REPORT_SIZE                     */
+    0x81, 0x06,         /*       INPUT (Data,Var,Rel)           */
+    0xc0,               /*     END_COLLECTION                   */
     0xc0,               /*   END_COLLECTION                     */
     0x09, 0x3c,         /*   USAGE (Motion Wakeup)              */
     0xc0                /* END_COLLECTION                       */
@@ -186,7 +325,10 @@ const struct usb_string_descriptor * const strings[] = {
 static void clock_setup(void) {
 
     set_sysclk_72mhz();
+    boot_mark(BOOT_CLOCK);
+
     RCC->APB1ENR |= RCC_APB1ENR_TIM2EN_;
+    RCC->APB1ENR |= RCC_APB1ENR_TIM4EN_;
     RCC->APB2ENR |= RCC_APB2ENR_SPI1EN_;
     RCC->APB2ENR |= RCC_APB2ENR_IOPAEN_;
     RCC->APB2ENR |= RCC_APB2ENR_IOPBEN_;
@@ -196,22 +338,6 @@ static void clock_setup(void) {
 
 static void gpio_setup(void) {
 
-    /* PA10 (L_NC): input with pull-up */
-    GPIOA->CRH = (GPIOA->CRH & ~GPIO_CRH_CNFMODE10_Msk) | (GPIO_CNFMODE_INPUT_PUPD << GPIO_CRH_CNFMODE10_Shft);
-    GPIOA->ODR |= GPIO10;
-
-    /* PA9 (L_NO): input with pull-up */
-    GPIOA->CRH = (GPIOA->CRH & ~GPIO_CRH_CNFMODE9_Msk)  | (GPIO_CNFMODE_INPUT_PUPD << GPIO_CRH_CNFMODE9_Shft);
-    GPIOA->ODR |= GPIO9;
-
-    /* PB12 (R_NC): input with pull-up */
-    GPIOB->CRH = (GPIOB->CRH & ~GPIO_CRH_CNFMODE12_Msk) | (GPIO_CNFMODE_INPUT_PUPD << GPIO_CRH_CNFMODE12_Shft);
-    GPIOB->ODR |= GPIO12;
-
-    /* PA8 (R_NO): input with pull-up */
-    GPIOA->CRH = (GPIOA->CRH & ~GPIO_CRH_CNFMODE8_Msk)  | (GPIO_CNFMODE_INPUT_PUPD << GPIO_CRH_CNFMODE8_Shft);
-    GPIOA->ODR |= GPIO8;
-
     /* rm0008 9.1.11 table 25
      * SPI GPIO configurations */
     
@@ -230,52 +356,59 @@ static void gpio_setup(void) {
 
 }
 
-static void tim_setup(void) {
+/* scroll wheel: TIM4 in encoder mode on PB6 (CH1) / PB7 (CH2).
+ * TIM3's pins (PA6/PA7) are taken by SPI1. the timer does all the
+ * counting, so there's no interrupt per detent and no missed steps at any
+ * speed the input filter lets through. the report path just reads CNT */
+static void wheel_setup(void) {
 
-    /* 72MHz / 72 = 1MHz */
-    TIM2->PSC = 71;
+    /* PB6, PB7: input with pull-up, the encoder's common goes to ground */
+    GPIOB->CRL = (GPIOB->CRL & ~(GPIO_CRL_CNFMODE6_Msk | GPIO_CRL_CNFMODE7_Msk))
+                             | (GPIO_CNFMODE_INPUT_PUPD << GPIO_CRL_CNFMODE6_Shft)
+                             | (GPIO_CNFMODE_INPUT_PUPD << GPIO_CRL_CNFMODE7_Shft);
+    GPIOB->ODR |= GPIO6 | GPIO7;
 
-    /* generate update event: apply PSC */
-    TIM2->EGR |= TIM_EGR_UG_;
+    /* IC1 <- TI1, IC2 <- TI2, both through the longest filter (~3.5us at 72MHz) */
+    TIM4->CCMR1 = (TIM4->CCMR1 & ~(TIM_CCMR1_CC1S_Msk | TIM_CCMR1_IC1F_Msk
+                                 | TIM_CCMR1_CC2S_Msk | TIM_CCMR1_IC2F_Msk))
+                               | (TIM_CCMR1_CC1S_TI1 | TIM_CCMR1_IC1F_DTS32_N8
+                                 | TIM_CCMR1_CC2S_TI2 | TIM_CCMR1_IC2F_DTS32_N8);
 
-    /* enable TIM2 counter */
-    TIM2->CR1 |= TIM_CR1_CEN_;
+    /* non-inverted. set CC1P to flip the scroll direction */
+    TIM4->CCER &= ~(TIM_CCER_CC1P_ | TIM_CCER_CC2P_);
+
+    /* count on both inputs' edges */
+    TIM4->SMCR = (TIM4->SMCR & ~TIM_SMCR_SMS_Msk) | TIM_SMCR_SMS_ENCODER3;
+
+    /* full 16-bit range, the report path works with differences */
+    TIM4->ARR = 0xFFFF;
+    TIM4->CNT = 0;
+    wheel_last = 0;
+
+    TIM4->CR1 |= TIM_CR1_CEN_;
 
 }
 
-static void exti_setup(void) {
-    
-    /* map EXTI lines 8-10 to PA8-10 */
-    AFIO->EXTICR[2] = (AFIO->EXTICR[2] & ~(AFIO_EXTICR3_EXTI8_Msk
-                                          | AFIO_EXTICR3_EXTI9_Msk
-                                          | AFIO_EXTICR3_EXTI10_Msk))
-                                        | (AFIO_EXTICR3_EXTI8_PA8 
-                                          | AFIO_EXTICR3_EXTI9_PA9
-                                          | AFIO_EXTICR3_EXTI10_PA10);
-
-    /* map EXTI line 12 to PB12 */
-    AFIO->EXTICR[3] = (AFIO->EXTICR[3] & ~AFIO_EXTICR4_EXTI12_Msk) | (AFIO_EXTICR4_EXTI12_PB12);
-
-    /* unmask line 9 (L_NO) for now, keep line 10 masked (L_NC) */
-    EXTI->IMR |=  EXTI9;
-    EXTI->IMR &= ~EXTI10;
-
-    /* unmask line 8 (R_NO) for now, keep line 12 masked (R_NC) */
-    EXTI->IMR |=  EXTI8;
-    EXTI->IMR &= ~EXTI12;
-
-    /* enable falling-edge triggers */
-    EXTI->FTSR |= EXTI8;
-    EXTI->FTSR |= EXTI9;
-    EXTI->FTSR |= EXTI10;
-    EXTI->FTSR |= EXTI12;
-
-    /* clear any potential spurious pending bits */
-    EXTI->PR = EXTI8 | EXTI9 | EXTI10 | EXTI12;
-
-    /* enable interrupts at NVIC level */
-    NVIC->ISER[NVIC_EXTI9_5_IRQ / 32] = (1 << (NVIC_EXTI9_5_IRQ % 32));
-    NVIC->ISER[NVIC_EXTI15_10_IRQ / 32] = (1 << (NVIC_EXTI15_10_IRQ % 32));
+/* wheel movement since the last call: raw counts if the host turned on the
+ * resolution multiplier, else whole detents with partial ones left in the
+ * counter */
+static int16_t wheel_read(void) {
+
+    int16_t counts  = (int16_t)(TIM4->CNT - wheel_last);
+
+    if (hid_feature.multiplier) {
+        /* whatever doesn't fit the report field stays in the counter */
+        counts = MIN(MAX(counts, -REPORT_DELTA_MAX), REPORT_DELTA_MAX);
+        wheel_last += counts;
+        return counts;
+    }
+
+    int16_t detents = counts / WHEEL_COUNTS_PER_DETENT;
+    detents = MIN(MAX(detents, -REPORT_DELTA_MAX), REPORT_DELTA_MAX);
+
+    wheel_last += detents * WHEEL_COUNTS_PER_DETENT;
+
+    return detents;
 
 }
 
@@ -284,8 +417,15 @@ static void spi_setup(void) {
     /* at reset, configured as 2-line unidirectional full-duplex.
      * this is standard 4-wire SPI, so we'll keep it this way */
 
+    /* pick the fastest prescaler that keeps SCLK within the sensor's limit.
+     * the sensor timings are enforced by paw3395.c, not by a slow bus */
+    uint32_t br = 0;
+    while (((PCLK2_HZ / 2) >> br) > PAW3395_SCLK_MAX_HZ) {
+        br++;
+    }
+
     /* otherwise, let's set our communication parameters */
-    SPI1->CR1 = (SPI1->CR1 & ~SPI_CR1_BR_Msk) | (SPI_CR1_BR_FPCLK_DIV8);
+    SPI1->CR1 = (SPI1->CR1 & ~SPI_CR1_BR_Msk) | (br << SPI_CR1_BR_Shft);
     SPI1->CR1 |= SPI_CR1_CPOL_;
     SPI1->CR1 |= SPI_CR1_CPHA_;
     SPI1->CR1 &= ~SPI_CR1_DFF_;
@@ -326,23 +466,325 @@ handle_hid_get_report_descriptor(usb_device *dev, struct usb_setup_data *req, ui
     return USB_REQ_HANDLED;
 }
 
+/* only the feature report is handled here. SET_IDLE etc. fall through to
+ * the std handlers and get stalled, as before */
+static enum usb_req_result
+handle_hid_class_request(usb_device *dev, struct usb_setup_data *req, uint8_t **buf, 
+                         uint16_t *len, usb_ep0_req_complete_callback *cb) {
+    (void)dev;
+    (void)cb;
+
+    /* no report IDs in use, so the low byte is always 0 */
+    if (req->wValue != (USB_HID_REPORT_TYPE_FEATURE << 8)) {
+        return USB_REQ_DEFER;
+    }
+
+    switch (req->bRequest) {
+
+        case USB_HID_REQ_TYPE_GET_REPORT:
+
+            *buf = (uint8_t *)&hid_feature;
+            *len = MIN(*len, sizeof(hid_feature));
+
+            return USB_REQ_HANDLED;
+
+        case USB_HID_REQ_TYPE_SET_REPORT:
+
+            if (*len < sizeof(hid_feature)) {
+                return USB_REQ_ERR;
+            }
+
+            /* 2-bit field, logical max 1 */
+            hid_feature.multiplier = MIN((*buf)[0] & 0b11, 1);
+
+            #if DBG >= 1
+            SEGGER_RTT_printf(0, "wheel resolution multiplier: %d\n", hid_feature.multiplier);
+            #endif
+
+            return USB_REQ_HANDLED;
+
+        default:
+            return USB_REQ_DEFER;
+    }
+}
+
+static enum usb_req_result
+handle_vendor_request(usb_device *dev, struct usb_setup_data *req, uint8_t **buf, 
+                      uint16_t *len, usb_ep0_req_complete_callback *cb) {
+    (void)dev;
+    (void)cb;
+
+    switch (req->bRequest) {
+
+        case MOUSE_REQ_SET_DPI:
+        case MOUSE_REQ_SET_DPI_XY:
+
+            if (((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_OUT)
+                || (req->wValue == 0)
+                || ((req->bRequest == MOUSE_REQ_SET_DPI_XY) && (req->wIndex == 0))) {
+                return USB_REQ_ERR;
+            }
+
+            /* don't touch the sensor here: hand it to `send_hid_report()`,
+             * which applies it before its next burst */
+            pending_dpi_x = req->wValue;
+            pending_dpi_y = (req->bRequest == MOUSE_REQ_SET_DPI_XY) ? req->wIndex : req->wValue;
+            pending_dpi   = 1;
+
+            #if DBG >= 1
+            SEGGER_RTT_printf(0, "set dpi: x %d, y %d\n", pending_dpi_x, pending_dpi_y);
+            #endif
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_GET_DPI:
+
+            if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_IN) {
+                return USB_REQ_ERR;
+            }
+
+            /* what the sensor is actually running at, after rounding. a set
+             * that hasn't reached the report path yet isn't reported */
+            paw_get_resolution(&dpi_reply[0], &dpi_reply[1]);
+            *buf = (uint8_t *)dpi_reply;
+            *len = MIN(*len, sizeof(dpi_reply));
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_SET_PERF_MODE:
+
+            if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_OUT
+                || (req->wValue >= PAW_MODE_COUNT)) {
+                return USB_REQ_ERR;
+            }
+
+            #if DBG >= 1
+            SEGGER_RTT_printf(0, "set perf mode: %d, rest: %d\n", req->wValue, req->wIndex);
+            #endif
+
+            /* ep0 is serviced from the same loop as the report path, so this
+             * can't land in the middle of a motion burst */
+            paw_set_mode(req->wValue);
+            paw_set_rest(req->wIndex);
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_SET_ANGLE:
+
+            if (((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_OUT)
+                || ((int16_t)req->wValue < MOTION_ANGLE_MIN)
+                || ((int16_t)req->wValue > MOTION_ANGLE_MAX)) {
+                return USB_REQ_ERR;
+            }
+
+            #if DBG >= 1
+            SEGGER_RTT_printf(0, "set angle: %d\n", (int16_t)req->wValue);
+            #endif
+
+            /* same loop as the report path, can't land mid-transform */
+            motion_set_angle((int16_t)req->wValue);
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_SET_CURVE_POINT:
+
+            if (((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_OUT)
+                || (motion_curve_set_point(req->wIndex, req->wValue) < 0)) {
+                return USB_REQ_ERR;
+            }
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_SET_CURVE:
+
+            if (((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_OUT)
+                || (motion_curve_commit(req->wValue, req->wIndex) < 0)) {
+                return USB_REQ_ERR;
+            }
+
+            #if DBG >= 1
+            SEGGER_RTT_printf(0, "set curve: enable %d, step %d\n", req->wValue, 1 << req->wIndex);
+            #endif
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_GET_LATENCY:
+
+            if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_IN) {
+                return USB_REQ_ERR;
+            }
+
+            /* the ISRs own the drop counter, so it's never reset: clearing
+             * moves the baseline instead */
+            latency_get(&latency_reply);
+            latency_reply.dropped = buttons_dropped() - dropped_cleared;
+            if (req->wValue) {
+                latency_reset();
+                dropped_cleared += latency_reply.dropped;
+            }
+
+            *buf = (uint8_t *)&latency_reply;
+            *len = MIN(*len, sizeof(latency_reply));
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_GET_SCHED:
+
+            if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_IN) {
+                return USB_REQ_ERR;
+            }
+
+            /* the report path runs in the usb handler, which this runs in
+             * too, so the copy can't tear */
+            sched_get_stats(sched_reply.events);
+            sched_reply.report = report_stats;
+            if (req->wValue) {
+                sched_reset_stats();
+                report_stats = (struct report_stats){0};
+            }
+
+            *buf = (uint8_t *)&sched_reply;
+            *len = MIN(*len, sizeof(sched_reply));
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_GET_IDLE:
+
+            if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_IN) {
+                return USB_REQ_ERR;
+            }
+
+            sched_get_idle_stats(&idle_reply);
+            if (req->wValue) {
+                sched_reset_idle_stats();
+            }
+
+            *buf = (uint8_t *)&idle_reply;
+            *len = MIN(*len, sizeof(idle_reply));
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_GET_BOOT:
+
+            if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_IN) {
+                return USB_REQ_ERR;
+            }
+
+            boot_get(&boot_reply);
+
+            *buf = (uint8_t *)&boot_reply;
+            *len = MIN(*len, sizeof(boot_reply));
+
+            return USB_REQ_HANDLED;
+
+        case MOUSE_REQ_GET_STACK:
+
+            if ((req->bmRequestType & USB_REQ_TYPE_DIRECTION) != USB_REQ_TYPE_IN) {
+                return USB_REQ_ERR;
+            }
+
+            stack_get(&stack_reply);
+
+            *buf = (uint8_t *)&stack_reply;
+            *len = MIN(*len, sizeof(stack_reply));
+
+            return USB_REQ_HANDLED;
+
+        default:
+            return USB_REQ_DEFER;
+    }
+}
+
+/* fit `d` into a report field, keeping the excess for the next report */
+static report_delta_t report_delta(int32_t d, int32_t *carry) {
+
+    int32_t total = d + *carry;
+    int32_t out   = MIN(MAX(total, -REPORT_DELTA_MAX), REPORT_DELTA_MAX);
+
+    *carry = total - out;
+    return out;
+
+}
+
 static void send_hid_report(usb_device *dev, uint8_t ep) {
 
     (void)ep;
     struct hid_mouse_report report  = {0};
     uint8_t paw_data[BURST_SIZE]    = {0};
     int16_t dx = 0, dy = 0;
+    uint32_t entry = now_cycles();
+    uint32_t start, cycles;
+
+    /* we're here on CTR IN: the last report was just collected */
+    if (report_has_change) {
+        latency_record(report_stamp);
+    }
+
+    /* apply a new resolution between bursts, so this report is the first
+     * one taken at the new dpi */
+    if (pending_dpi) {
+        pending_dpi = 0;
+        paw_set_resolution(pending_dpi_x, pending_dpi_y);
+    }
 
     paw_motion_burst(paw_data, sizeof(paw_data));
     dx = (int16_t) ( (paw_data[3] << 8) | (paw_data[2] << 0) );
     dy = (int16_t) ( (paw_data[5] << 8) | (paw_data[4] << 0) );
 
-    report.buttons  = ((r_click << 1) | (l_click << 0));
-    report.x        = dx;
-    report.y        = dy;
-
+    /* the motion stage has to stay a small, fixed slice of the frame */
+    start  = now_cycles();
+    motion_apply(&dx, &dy);
+    cycles = now_cycles() - start;
+
+    report_stats.reports++;
+    report_stats.motion_cycles += cycles;
+    report_stats.motion_max_cycles = MAX(report_stats.motion_max_cycles, cycles);
+
+    /* one state change per report, so none get merged away. repeating a
+     * patched one would also hold off patching the next click */
+    struct button_event ev = {0};
+    if (queued_sent) {
+        queued_sent = 0;
+        (void)buttons_pop(&ev);
+    }
+    uint8_t change = buttons_pop(&ev);
+    report.buttons  = change ? ev.state : buttons_get();
+    report.x        = report_delta(dx, &carry_x);
+    report.y        = report_delta(dy, &carry_y);
+    report.wheel    = wheel_read();
+
+    /* set before the buffer goes VALID, the click ISR only looks at it then */
+    report_has_change = change;
+    report_stamp      = ev.stamp;
     usb_ep_write_packet(dev, 0x81, &report, sizeof(report));
 
+    cycles = now_cycles() - entry;
+    report_stats.report_cycles += cycles;
+    report_stats.report_max_cycles = MAX(report_stats.report_max_cycles, cycles);
+
+}
+
+/* runs in the EXTI ISR: the report sitting in ep1's buffer was built before
+ * this click, and would only carry it a poll later. if it hasn't gone out
+ * yet, swap the new button byte into it.
+ * the change stays queued either way: if the patch fails the next report
+ * carries it, if it works the next report drops it (`queued_sent`) */
+static void buttons_changed(const struct button_event *ev, uint8_t first) {
+
+    /* an older change is still waiting, or is in the buffer itself:
+     * patching would reorder or drop it */
+    if (!first || report_has_change) {
+        return;
+    }
+
+    if (usb_ep_patch_packet(usb_dev, 0x81, offsetof(struct hid_mouse_report, buttons), &ev->state, sizeof(ev->state)) != 0xffff) {
+        report_has_change = 1;
+        report_stamp      = ev->stamp;
+
+        /* `first`: it's the oldest queued, the next pop returns it */
+        queued_sent       = 1;
+    }
+
 }
 
 static void hid_set_configuration(usb_device *dev, uint16_t wValue) {
@@ -356,97 +798,101 @@ static void hid_set_configuration(usb_device *dev, uint16_t wValue) {
         USB_REQ_TYPE_DIRECTION | USB_REQ_TYPE_TYPE     | USB_REQ_TYPE_RECIPIENT, 
         handle_hid_get_report_descriptor);
 
-    /* fill ep1 tx buffer with first report; start chain of CTR IN events */
-    send_hid_report(dev, 0x81);
-
-}
-
-int main(void) {
-
-    clock_setup();
-    gpio_setup();
-    tim_setup();
-    exti_setup();
-    spi_setup();
-
-    paw_init();
-    paw_set_dpi(800);
+    usb_register_ep0_req_handler(dev, 
+        USB_REQ_TYPE_CLASS  | USB_REQ_TYPE_INTERFACE,
+        USB_REQ_TYPE_TYPE   | USB_REQ_TYPE_RECIPIENT, 
+        handle_hid_class_request);
 
-    /* receive usb device handler */
-    usb_dev = usb_init(&device_descriptor, &hid_mouse_cfg_block.config, strings, 4);
+    usb_register_ep0_req_handler(dev, 
+        USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_DEVICE,
+        USB_REQ_TYPE_TYPE   | USB_REQ_TYPE_RECIPIENT, 
+        handle_vendor_request);
 
-    /* register the func that will run when the host sends the `set_configuration` request */
-    usb_register_set_config_callback(usb_dev, hid_set_configuration);
+    buttons_register_callback(buttons_changed);
+    report_has_change = 0;
+    queued_sent       = 0;
 
-    /* enable peripheral, start enumeration */
-    usb_start(usb_dev);
+    /* hosts that support it set the multiplier after every configuration */
+    hid_feature.multiplier = 0;
 
-    for (;;) {
-        usb_handle_event(usb_dev);
-    }
+    /* fill ep1 tx buffer with first report; start chain of CTR IN events */
+    send_hid_report(dev, 0x81);
+    boot_mark(BOOT_REPORT);
 
 }
 
-/* 
- * SPDT 0-latency debounce logic (SR-Latch emulation) 
- */
-
-void exti9_5_isr(void) {
-
-    if (EXTI->PR & EXTI9) {
-        
-        /* disable PA9 (L_NO), enable PA10 (L_NC) */
-        EXTI->IMR &= ~EXTI9;
-        EXTI->IMR |=  EXTI10;
-
-        /* clear pending bits */
-        EXTI->PR = EXTI9 | EXTI10;
+/* the USB interrupt is level-triggered on the ISTR flags, so it stays masked
+ * from here until the handler has dealt with them. if anything is still
+ * pending when it's unmasked, it fires (and posts) again right away */
+void usb_lp_can_rx0_isr(void) {
+    sched_woken(now_cycles());
+    irq_disable(NVIC_USB_LP_CAN_RX0_IRQ);
+    sched_post(SCHED_EV_USB);
+}
 
-        l_click = 1;
+static void usb_event(void) {
+    usb_handle_event(usb_dev);
+    usb_enable_isr();
+}
 
-    }
+#if DBG >= 1
+/* every second, publish the click latency stats over RTT. the timer fires in
+ * the SysTick ISR, the printing happens in the main loop */
+static struct timer stats_timer;
 
-    if (EXTI->PR & EXTI8) {
+static void stats_tick(void *arg) {
+    (void)arg;
+    sched_post(SCHED_EV_STATS);
+}
 
-        /* disable PA8 (R_NO), enable PB12 (R_NC) */
-        EXTI->IMR &= ~EXTI8;
-        EXTI->IMR |=  EXTI12;
+static void stats_publish(void) {
 
-        /* clear pending bits */
-        EXTI->PR = EXTI8 | EXTI12;
+    struct latency_stats stats;
 
-        r_click = 1;
-
-    }
+    latency_get(&stats);
+    SEGGER_RTT_printf(0, "latency: %u edges, max %u us\n", stats.count, stats.max_cycles / (sysclk_hz / 1000000));
 
 }
+#endif
 
-void exti15_10_isr(void) {
+int main(void) {
 
-    if (EXTI->PR & EXTI10) {
-        
-        /* disable PA10 (L_NC), enable PA9 (L_NO) */
-        EXTI->IMR &= ~EXTI10;
-        EXTI->IMR |=  EXTI9;
+    #if IRQ_RAM_VECTORS
+    irq_vectors_to_ram();
+    #endif
 
-        /* clear pending bits */
-        EXTI->PR = EXTI9 | EXTI10;
+    clock_setup();
+    dwt_init();
+    gpio_setup();
+    timebase_init();
+    timer_init();
+    latency_init();
+    buttons_init();
+    wheel_setup();
+    spi_setup();
 
-        l_click = 0;
+    paw_init();
+    boot_mark(BOOT_SENSOR);
+    paw_set_dpi(800);
 
-    }
+    /* receive usb device handler */
+    usb_dev = usb_init(&device_descriptor, &hid_mouse_cfg_block.config, strings, 4);
 
-    if (EXTI->PR & EXTI12) {
+    /* register the func that will run when the host sends the `set_configuration` request */
+    usb_register_set_config_callback(usb_dev, hid_set_configuration);
 
-        /* disable PB12 (R_NC), enable PA8 (R_NO) */
-        EXTI->IMR &= ~EXTI12;
-        EXTI->IMR |=  EXTI8;
+    /* enable peripheral, start enumeration */
+    usb_start(usb_dev);
 
-        /* clear pending bits */
-        EXTI->PR = EXTI8 | EXTI12;
+    sched_register(SCHED_EV_USB, usb_event);
+    usb_enable_isr();
 
-        r_click = 0;
+    #if DBG >= 1
+    sched_register(SCHED_EV_STATS, stats_publish);
+    timer_setup(&stats_timer, stats_tick, NULL);
+    timer_start(&stats_timer, 1000, 1000);
+    #endif
 
-    }
+    sched_run();
 
 }
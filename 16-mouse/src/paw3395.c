@@ -4,26 +4,381 @@
 #include "gpio.h"
 #include "spim.h"
 #include "delay.h"
+#include "dwt.h"
 #include "utils.h"
 #include "paw3395.h"
 
+#include "SEGGER_RTT.h"
+
 #define POWER_ON_SEQUENCE 0
 
+/* bank currently selected in the sensor (register 0x7F) */
+static uint8_t paw_bank;
+
+/* write-through shadow of the config registers (0x40-0x7E) in the banks we
+ * touch at runtime. lets `paw_modify()` skip the read half of a
+ * read-modify-write. an entry is only trusted once it has been written, or
+ * read once by `paw_modify()` itself.
+ */
+#define PAW_SHADOW_BASE     0x40
+#define PAW_SHADOW_SIZE     (PAW3395_BANK_SELECT - PAW_SHADOW_BASE)
+
+struct paw_shadow {
+    uint8_t  bank;
+    uint32_t valid[2];
+    uint8_t  reg[PAW_SHADOW_SIZE];
+};
+
+static struct paw_shadow paw_shadows[] = {
+    { .bank = 0x00 },
+    { .bank = 0x05 },
+    { .bank = 0x07 },
+    { .bank = 0x0D },
+};
+
+/* shadow of the selected bank, NULL if that bank isn't shadowed */
+static struct paw_shadow *paw_shadow;
+
+/* step 6 of the power on sequence (section 6.0), stored as data rather than
+ * 145 unrolled `paw_write()`s. every run of writes that shares a bank is
+ * grouped behind one bank select, and the comments keep the datasheet's
+ * write numbering so the table can be checked against it line by line.
+ *
+ * built even with POWER_ON_SEQUENCE at 0, `paw_init()` only skips running
+ * it, so the table keeps compiling against the `PAW_SEQ_*` encoding.
+ */
+static const uint8_t paw3395_power_on_seq[] = {
+
+    /* 1-2 */
+    PAW_SEQ_BANK(0x07,
+        0x40, 0x41
+    ),
+    /* 3-4 */
+    PAW_SEQ_BANK(0x00,
+        0x40, 0x80
+    ),
+    /* 5-9 */
+    PAW_SEQ_BANK(0x0E,
+        0x55, 0x0D, 0x56, 0x1B, 0x57, 0xE8, 0x58, 0xD5
+    ),
+    /* 10-15 */
+    PAW_SEQ_BANK(0x14,
+        0x42, 0xBC, 0x43, 0x74, 0x4B, 0x20, 0x4D, 0x00,
+        0x53, 0x0E
+    ),
+    /* 16-30 */
+    PAW_SEQ_BANK(0x05,
+        0x44, 0x04, 0x4D, 0x06, 0x51, 0x40, 0x53, 0x40,
+        0x55, 0xCA, 0x5A, 0xE8, 0x5B, 0xEA, 0x61, 0x31,
+        0x62, 0x64, 0x6D, 0xB8, 0x6E, 0x0F, 0x70, 0x02,
+        0x4A, 0x2A, 0x60, 0x26
+    ),
+    /* 31-38 */
+    PAW_SEQ_BANK(0x06,
+        0x6D, 0x70, 0x6E, 0x60, 0x6F, 0x04, 0x53, 0x02,
+        0x55, 0x11, 0x7A, 0x01, 0x7D, 0x51
+    ),
+    /* 39-42 */
+    PAW_SEQ_BANK(0x07,
+        0x41, 0x10, 0x42, 0x32, 0x43, 0x00
+    ),
+    /* 43-44 */
+    PAW_SEQ_BANK(0x08,
+        0x71, 0x4F
+    ),
+    /* 45-61 */
+    PAW_SEQ_BANK(0x09,
+        0x62, 0x1F, 0x63, 0x1F, 0x65, 0x03, 0x66, 0x03,
+        0x67, 0x1F, 0x68, 0x1F, 0x69, 0x03, 0x6A, 0x03,
+        0x6C, 0x1F, 0x6D, 0x1F, 0x51, 0x04, 0x53, 0x20,
+        0x54, 0x20, 0x71, 0x0C, 0x72, 0x07, 0x73, 0x07
+    ),
+    /* 62-65 */
+    PAW_SEQ_BANK(0x0A,
+        0x4A, 0x14, 0x4C, 0x14, 0x55, 0x19
+    ),
+    /* 66-71 */
+    PAW_SEQ_BANK(0x14,
+        0x4B, 0x30, 0x4C, 0x03, 0x61, 0x0B, 0x62, 0x0A,
+        0x63, 0x02
+    ),
+    /* 72-76 */
+    PAW_SEQ_BANK(0x15,
+        0x4C, 0x02, 0x56, 0x02, 0x41, 0x91, 0x4D, 0x0A
+    ),
+    /* 77-92 */
+    PAW_SEQ_BANK(0x0C,
+        0x4A, 0x10, 0x4B, 0x0C, 0x4C, 0x40, 0x41, 0x25,
+        0x55, 0x18, 0x56, 0x14, 0x49, 0x0A, 0x42, 0x00,
+        0x43, 0x2D, 0x44, 0x0C, 0x54, 0x1A, 0x5A, 0x0D,
+        0x5F, 0x1E, 0x5B, 0x05, 0x5E, 0x0F
+    ),
+    /* 93-115 */
+    PAW_SEQ_BANK(0x0D,
+        0x48, 0xDD, 0x4F, 0x03, 0x52, 0x49, 0x51, 0x00,
+        0x54, 0x5B, 0x53, 0x00, 0x56, 0x64, 0x55, 0x00,
+        0x58, 0xA5, 0x57, 0x02, 0x5A, 0x29, 0x5B, 0x47,
+        0x5C, 0x81, 0x5D, 0x40, 0x71, 0xDC, 0x70, 0x07,
+        0x73, 0x00, 0x72, 0x08, 0x75, 0xDC, 0x74, 0x07,
+        0x77, 0x00, 0x76, 0x08
+    ),
+    /* 116-117 */
+    PAW_SEQ_BANK(0x10,
+        0x4C, 0xD0
+    ),
+    /* 118-137 */
+    PAW_SEQ_BANK(0x00,
+        0x4F, 0x63, 0x4E, 0x00, 0x52, 0x63, 0x51, 0x00,
+        0x54, 0x54, 0x5A, 0x10, 0x77, 0x4F, 0x47, 0x01,
+        0x5B, 0x40, 0x64, 0x60, 0x65, 0x06, 0x66, 0x13,
+        0x67, 0x0F, 0x78, 0x01, 0x79, 0x9C, 0x40, 0x00,
+        0x55, 0x02, 0x23, 0x70, 0x22, 0x01
+    ),
+
+    /* 138 */
+    PAW_SEQ_DELAY(1),
+
+    /* 139: poll 0x6C for 0x80, if it never shows up, run a-c */
+    PAW_SEQ_POLL(0x6C, 0x80, 60,
+        PAW_SEQ_BANK(0x14,
+            0x6C, 0x00
+        )
+    ),
+
+    /* c, 140-141 */
+    PAW_SEQ_BANK(0x00,
+        0x22, 0x00, 0x55, 0x00
+    ),
+
+    /* 142-143 */
+    PAW_SEQ_BANK(0x07,
+        0x40, 0x40
+    ),
+
+    /* 144-145 */
+    PAW_SEQ_BANK(0x00,
+        0x68, 0x01
+    ),
+
+    PAW_SEQ_END
+};
+
+/* section 7: per-mode register settings. each table ends in bank 0, and
+ * PERFORMANCE[1:0] is set by `paw_set_mode()` afterwards. the high
+ * performance table matches what the power on sequence leaves behind.
+ */
+static const uint8_t paw3395_mode_high_performance[] = {
+    PAW_SEQ_BANK(0x05,
+        0x51, 0x40, 0x53, 0x40, 0x61, 0x31, 0x6E, 0x0F
+    ),
+    PAW_SEQ_BANK(0x07,
+        0x42, 0x32, 0x43, 0x00
+    ),
+    PAW_SEQ_BANK(0x0D,
+        0x52, 0x49, 0x51, 0x00, 0x54, 0x5B, 0x53, 0x00,
+        0x56, 0x64, 0x55, 0x00, 0x58, 0xA5, 0x57, 0x02
+    ),
+    PAW_SEQ_BANK(0x00,
+        0x54, 0x54, 0x78, 0x01, 0x79, 0x9C
+    ),
+    PAW_SEQ_END
+};
+
+static const uint8_t paw3395_mode_low_power[] = {
+    PAW_SEQ_BANK(0x05,
+        0x51, 0x40, 0x53, 0x40, 0x61, 0x3B, 0x6E, 0x1F
+    ),
+    PAW_SEQ_BANK(0x07,
+        0x42, 0x32, 0x43, 0x00
+    ),
+    PAW_SEQ_BANK(0x0D,
+        0x52, 0x49, 0x51, 0x00, 0x54, 0x5B, 0x53, 0x00,
+        0x56, 0x64, 0x55, 0x00, 0x58, 0xA5, 0x57, 0x02
+    ),
+    PAW_SEQ_BANK(0x00,
+        0x54, 0x55, 0x78, 0x01, 0x79, 0x9C
+    ),
+    PAW_SEQ_END
+};
+
+static const uint8_t paw3395_mode_office[] = {
+    PAW_SEQ_BANK(0x05,
+        0x51, 0x28, 0x53, 0x30, 0x61, 0x3B, 0x6E, 0x1F
+    ),
+    PAW_SEQ_BANK(0x07,
+        0x42, 0x32, 0x43, 0x00
+    ),
+    PAW_SEQ_BANK(0x0D,
+        0x52, 0x49, 0x51, 0x00, 0x54, 0x5B, 0x53, 0x00,
+        0x56, 0x64, 0x55, 0x00, 0x58, 0xA5, 0x57, 0x02
+    ),
+    PAW_SEQ_BANK(0x00,
+        0x54, 0x55, 0x78, 0x01, 0x79, 0x9C
+    ),
+    PAW_SEQ_END
+};
+
+static const uint8_t paw3395_mode_corded_gaming[] = {
+    PAW_SEQ_BANK(0x05,
+        0x51, 0x40, 0x53, 0x40, 0x61, 0x31, 0x6E, 0x0F
+    ),
+    PAW_SEQ_BANK(0x07,
+        0x42, 0x2F, 0x43, 0x00
+    ),
+    PAW_SEQ_BANK(0x0D,
+        0x52, 0xDB, 0x51, 0x12, 0x54, 0xDC, 0x53, 0x12,
+        0x56, 0xEA, 0x55, 0x12, 0x58, 0x2D, 0x57, 0x15
+    ),
+    PAW_SEQ_BANK(0x00,
+        0x54, 0x55, 0x78, 0x01, 0x79, 0x9C
+    ),
+    PAW_SEQ_END
+};
+
+static const uint8_t * const paw3395_modes[PAW_MODE_COUNT] = {
+    [PAW_MODE_HIGH_PERFORMANCE] = paw3395_mode_high_performance,
+    [PAW_MODE_LOW_POWER]        = paw3395_mode_low_power,
+    [PAW_MODE_OFFICE]           = paw3395_mode_office,
+    [PAW_MODE_CORDED_GAMING]    = paw3395_mode_corded_gaming,
+};
+
+/* the sensor powers up in high performance mode */
+static enum paw_mode paw_mode = PAW_MODE_HIGH_PERFORMANCE;
+
+/* resolution as last written to the sensor, in DPI (0 until set) */
+static uint16_t paw_dpi_x;
+static uint16_t paw_dpi_y;
+
+/* returns the shadow entry for `addr` in the selected bank, NULL if not shadowed */
+static uint8_t *paw_shadow_entry(uint8_t addr, uint8_t *valid) {
+
+    uint8_t i = addr - PAW_SHADOW_BASE;
+
+    if (!paw_shadow || (addr < PAW_SHADOW_BASE) || (i >= PAW_SHADOW_SIZE)) {
+        return NULL;
+    }
+
+    *valid = (paw_shadow->valid[i >> 5] >> (i & 31)) & 1;
+    return &paw_shadow->reg[i];
+}
+
+static void paw_shadow_store(uint8_t addr, uint8_t data) {
+
+    uint8_t i = addr - PAW_SHADOW_BASE;
+    uint8_t valid;
+    uint8_t *entry = paw_shadow_entry(addr, &valid);
+
+    if (entry) {
+        *entry = data;
+        paw_shadow->valid[i >> 5] |= (1UL << (i & 31));
+    }
+}
+
+static void paw_shadow_select(uint8_t bank) {
+
+    paw_bank   = bank;
+    paw_shadow = NULL;
+
+    for (uint8_t i = 0; i < ARR_SIZE(paw_shadows); i++) {
+        if (paw_shadows[i].bank == bank) {
+            paw_shadow = &paw_shadows[i];
+        }
+    }
+}
+
+/* forget everything, e.g. after a power up reset */
+static void paw_shadow_reset(void) {
+
+    for (uint8_t i = 0; i < ARR_SIZE(paw_shadows); i++) {
+        paw_shadows[i].valid[0] = 0;
+        paw_shadows[i].valid[1] = 0;
+    }
+
+    /* the sensor comes out of reset in bank 0 */
+    paw_shadow_select(0x00);
+}
+
+/* ----------------------------------------------------------------------------------- */
+/* --- SPI TRANSPORT ----------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* everything that clocks the sensor goes through the helpers below, so the
+ * section 5 timings hold at any SCLK rate instead of relying on a slow bus.
+ *
+ * µs gaps are timed with the 1MHz TIM2 counter, the free-running low half
+ * of the timebase in delay.c; 16-bit differences are all we need. we stamp
+ * the end of every transaction and only spin for whatever part of the gap
+ * hasn't already passed. sub-µs NCS timings spin on the cycle counter.
+ */
+
+/* TIM2 stamp of the last SCLK edge, and how long the sensor needs after it
+ * before the next read or write may start */
+static uint16_t paw_idle_since;
+static uint8_t  paw_hold_read;
+static uint8_t  paw_hold_write;
+
+/* spin until at least `us` have passed since `since`.
+ * `<=` rounds up, since `since` may have been taken just before a tick */
+static void paw_wait_us(uint16_t since, uint8_t us) {
+    while ((uint16_t)(TIM2->CNT - since) <= us);
+}
+
+static void paw_idle(uint8_t hold_read, uint8_t hold_write) {
+    paw_idle_since = TIM2->CNT;
+    paw_hold_read  = hold_read;
+    paw_hold_write = hold_write;
+}
+
+static void paw_wait_idle(uint8_t hold) {
+    paw_wait_us(paw_idle_since, hold);
+}
+
+static void paw_select(void) {
+    gpio_clear(GPIOA, GPIO4);
+    delay_ns(PAW3395_T_NCS_SCLK_NS);
+}
+
+static void paw_deselect(uint32_t hold_ns) {
+    delay_ns(hold_ns);
+    gpio_set(GPIOA, GPIO4);
+}
+
+/* write without touching CS, for runs of writes under one CS assertion */
+static void paw_write_raw(uint8_t addr, uint8_t data) {
+
+    paw_wait_idle(paw_hold_write);
+
+    spi_transfer(SPI1, addr | (1 << 7));
+    spi_transfer(SPI1, data);
+
+    paw_idle(PAW3395_T_SWR_US, PAW3395_T_SWW_US);
+
+    if (addr == PAW3395_BANK_SELECT) {
+        paw_shadow_select(data);
+    }
+    else {
+        paw_shadow_store(addr, data);
+    }
+}
+
 static uint8_t paw_read(uint8_t addr) {
 
     uint8_t data;
 
     /* pull CS low: select this slave */
-    gpio_clear(GPIOA, GPIO4);
+    paw_select();
+    paw_wait_idle(paw_hold_read);
 
     /* send addr we wish to read with MSB cleared (read op) */
     spi_transfer(SPI1, addr);
+    paw_wait_us(TIM2->CNT, PAW3395_T_SRAD_US);
 
     /* receive reg data */
     data = spi_transfer(SPI1, 0);
+    paw_idle(PAW3395_T_SRR_US, PAW3395_T_SRW_US);
 
     /* pull CS high: transaction complete */
-    gpio_set(GPIOA, GPIO4);
+    paw_deselect(PAW3395_T_SCLK_NCS_READ_NS);
 
     return data;
 }
@@ -31,43 +386,164 @@ static uint8_t paw_read(uint8_t addr) {
 static void paw_write(uint8_t addr, uint8_t data) {
 
     /* pull CS low: select this slave */
-    gpio_clear(GPIOA, GPIO4);
+    paw_select();
 
-    /* send addr we wish to read with MSB set (write op) */
-    spi_transfer(SPI1, addr | (1 << 7));
-
-    /* write reg data */
-    spi_transfer(SPI1, data);
+    /* send addr with MSB set (write op), then reg data */
+    paw_write_raw(addr, data);
 
     /* pull CS high: transaction complete */
-    gpio_set(GPIOA, GPIO4);
+    paw_deselect(PAW3395_T_SCLK_NCS_WRITE_NS);
 
 }
 
+/* one SPI write if the register is shadowed, read + write on the first touch */
 static void paw_modify(uint8_t addr, uint8_t clearmask, uint8_t setmask) {
-    uint8_t reg = paw_read(addr);
+
+    uint8_t valid = 0;
+    uint8_t *entry = paw_shadow_entry(addr, &valid);
+    uint8_t reg = valid ? *entry : paw_read(addr);
+
     reg = (reg & ~clearmask) | (setmask);
     paw_write(addr, reg);
 }
 
-void paw_motion_burst(uint8_t *byte, uint8_t len) {
+/* interpreter for the `PAW_SEQ_*` register tables in paw3395.h.
+ *
+ * consecutive BANK groups are written under a single CS assertion, CS is
+ * only released for delays, polls and at the end of the table. bank selects
+ * for the bank we're already in are skipped.
+ */
+void paw_run_sequence(const uint8_t *seq) {
+
+    uint8_t selected = 0;
+    uint8_t bank, n, addr, val, tries, skip;
+
+    for (;;) {
+
+        switch (*seq++) {
+
+        case PAW_OP_BANK:
+
+            bank = *seq++;
+            n    = *seq++;
+
+            if (!selected) {
+                paw_select();
+                selected = 1;
+            }
+            if (bank != paw_bank) {
+                paw_write_raw(PAW3395_BANK_SELECT, bank);
+            }
+            for (; n; n--, seq += 2) {
+                paw_write_raw(seq[0], seq[1]);
+            }
+            break;
+
+        case PAW_OP_DELAY:
+
+            if (selected) {
+                paw_deselect(PAW3395_T_SCLK_NCS_WRITE_NS);
+                selected = 0;
+            }
+            delay_ms(*seq++);
+            break;
+
+        case PAW_OP_POLL:
+
+            if (selected) {
+                paw_deselect(PAW3395_T_SCLK_NCS_WRITE_NS);
+                selected = 0;
+            }
+
+            addr  = *seq++;
+            val   = *seq++;
+            tries = *seq++;
+            skip  = *seq++;
+
+            /* on a match, hop over the fallback ops; otherwise fall into them */
+            for (; tries; tries--) {
+                if (paw_read(addr) == val) {
+                    seq += skip;
+                    break;
+                }
+                delay_ms(1);
+            }
+            break;
+
+        case PAW_OP_END:
+        default:
+
+            if (selected) {
+                paw_deselect(PAW3395_T_SCLK_NCS_WRITE_NS);
+            }
+            return;
+        }
+    }
+}
+
+/* debug: read back every trusted shadow entry and compare against the device.
+ * returns the number of mismatches. registers that don't read back what was
+ * written (self-clearing bits, write-only triggers) will show up here too.
+ */
+int paw_shadow_verify(void) {
+
+    uint8_t bank = paw_bank;
+    int mismatches = 0;
+    uint8_t data;
+
+    for (uint8_t s = 0; s < ARR_SIZE(paw_shadows); s++) {
+
+        struct paw_shadow *shadow = &paw_shadows[s];
+
+        if (!(shadow->valid[0] | shadow->valid[1])) {
+            continue;
+        }
+
+        paw_write(PAW3395_BANK_SELECT, shadow->bank);
+
+        for (uint8_t i = 0; i < PAW_SHADOW_SIZE; i++) {
+
+            if (!((shadow->valid[i >> 5] >> (i & 31)) & 1)) {
+                continue;
+            }
+
+            data = paw_read(PAW_SHADOW_BASE + i);
+            if (data != shadow->reg[i]) {
+                mismatches++;
+                #if DBG >= 1
+                SEGGER_RTT_printf(0, "paw shadow: bank x%02X reg x%02X: shadow x%02X, device x%02X\n",
+                                  shadow->bank, PAW_SHADOW_BASE + i, shadow->reg[i], data);
+                #endif
+            }
+        }
+    }
+
+    paw_write(PAW3395_BANK_SELECT, bank);
+
+    return mismatches;
+}
+
+RAMFUNC void paw_motion_burst(uint8_t *byte, uint8_t len) {
 
     /* receive up to 12 bytes */
     uint8_t burst_len = MIN(len, MAX_BURST_SIZE);
 
     /* CS low */
-    gpio_clear(GPIOA, GPIO4);
+    paw_select();
+    paw_wait_idle(paw_hold_read);
 
     /* start by sending motion_burst addr */
     spi_transfer(SPI1, PAW3395_MOTION_BURST);
+    paw_wait_us(TIM2->CNT, PAW3395_T_SRAD_MOTBR_US);
 
-    /* receive burst data */
+    /* receive burst data, back to back */
     for (uint8_t i = 0; i < burst_len; i++) {
         byte[i] = spi_transfer(SPI1, 0);
     }
 
-    /* CS high */
-    gpio_set(GPIOA, GPIO4);
+    /* CS high, then tBEXIT before the next transaction */
+    paw_deselect(PAW3395_T_SCLK_NCS_READ_NS);
+    paw_idle((PAW3395_T_BEXIT_NS + 999) / 1000, (PAW3395_T_BEXIT_NS + 999) / 1000);
 
 }
 
@@ -92,174 +568,14 @@ void paw_init(void) {
     /* step 5 */
     delay_ms(10);
 
-    #if POWER_ON_SEQUENCE
+    /* nothing we knew about the registers survives the reset */
+    paw_shadow_reset();
 
     /* step 6 */
-    paw_write(0x7F, 0x07);  /* 1 */
-    paw_write(0x40, 0x41);  /* 2 */
-    paw_write(0x7F, 0x00);  /* 3 */
-    paw_write(0x40, 0x80);  /* 4 */
-    paw_write(0x7F, 0x0E);  /* 5 */
-    paw_write(0x55, 0x0D);  /* 6 */
-    paw_write(0x56, 0x1B);  /* 7 */
-    paw_write(0x57, 0xE8);  /* 8 */
-    paw_write(0x58, 0xD5);  /* 9 */
-    paw_write(0x7F, 0x14);  /* 10 */
-    paw_write(0x42, 0xBC);  /* 11 */
-    paw_write(0x43, 0x74);  /* 12 */
-    paw_write(0x4B, 0x20);  /* 13 */
-    paw_write(0x4D, 0x00);  /* 14 */
-    paw_write(0x53, 0x0E);  /* 15 */
-    paw_write(0x7F, 0x05);  /* 16 */
-    paw_write(0x44, 0x04);  /* 17 */
-    paw_write(0x4D, 0x06);  /* 18 */
-    paw_write(0x51, 0x40);  /* 19 */
-    paw_write(0x53, 0x40);  /* 20 */
-    paw_write(0x55, 0xCA);  /* 21 */
-    paw_write(0x5A, 0xE8);  /* 22 */
-    paw_write(0x5B, 0xEA);  /* 23 */
-    paw_write(0x61, 0x31);  /* 24 */
-    paw_write(0x62, 0x64);  /* 25 */
-    paw_write(0x6D, 0xB8);  /* 26 */
-    paw_write(0x6E, 0x0F);  /* 27 */
-    paw_write(0x70, 0x02);  /* 28 */
-    paw_write(0x4A, 0x2A);  /* 29 */
-    paw_write(0x60, 0x26);  /* 30 */
-    paw_write(0x7F, 0x06);  /* 31 */
-    paw_write(0x6D, 0x70);  /* 32 */
-    paw_write(0x6E, 0x60);  /* 33 */
-    paw_write(0x6F, 0x04);  /* 34 */
-    paw_write(0x53, 0x02);  /* 35 */
-    paw_write(0x55, 0x11);  /* 36 */
-    paw_write(0x7A, 0x01);  /* 37 */
-    paw_write(0x7D, 0x51);  /* 38 */
-    paw_write(0x7F, 0x07);  /* 39 */
-    paw_write(0x41, 0x10);  /* 40 */
-    paw_write(0x42, 0x32);  /* 41 */
-    paw_write(0x43, 0x00);  /* 42 */
-    paw_write(0x7F, 0x08);  /* 43 */
-    paw_write(0x71, 0x4F);  /* 44 */
-    paw_write(0x7F, 0x09);  /* 45 */
-    paw_write(0x62, 0x1F);  /* 46 */
-    paw_write(0x63, 0x1F);  /* 47 */
-    paw_write(0x65, 0x03);  /* 48 */
-    paw_write(0x66, 0x03);  /* 49 */
-    paw_write(0x67, 0x1F);  /* 50 */
-    paw_write(0x68, 0x1F);  /* 51 */
-    paw_write(0x69, 0x03);  /* 52 */
-    paw_write(0x6A, 0x03);  /* 53 */
-    paw_write(0x6C, 0x1F);  /* 54 */
-    paw_write(0x6D, 0x1F);  /* 55 */
-    paw_write(0x51, 0x04);  /* 56 */
-    paw_write(0x53, 0x20);  /* 57 */
-    paw_write(0x54, 0x20);  /* 58 */
-    paw_write(0x71, 0x0C);  /* 59 */
-    paw_write(0x72, 0x07);  /* 60 */
-    paw_write(0x73, 0x07);  /* 61 */
-    paw_write(0x7F, 0x0A);  /* 62 */
-    paw_write(0x4A, 0x14);  /* 63 */
-    paw_write(0x4C, 0x14);  /* 64 */
-    paw_write(0x55, 0x19);  /* 65 */
-    paw_write(0x7F, 0x14);  /* 66 */
-    paw_write(0x4B, 0x30);  /* 67 */
-    paw_write(0x4C, 0x03);  /* 68 */
-    paw_write(0x61, 0x0B);  /* 69 */
-    paw_write(0x62, 0x0A);  /* 70 */
-    paw_write(0x63, 0x02);  /* 71 */
-    paw_write(0x7F, 0x15);  /* 72 */
-    paw_write(0x4C, 0x02);  /* 73 */
-    paw_write(0x56, 0x02);  /* 74 */
-    paw_write(0x41, 0x91);  /* 75 */
-    paw_write(0x4D, 0x0A);  /* 76 */
-    paw_write(0x7F, 0x0C);  /* 77 */
-    paw_write(0x4A, 0x10);  /* 78 */
-    paw_write(0x4B, 0x0C);  /* 79 */
-    paw_write(0x4C, 0x40);  /* 80 */
-    paw_write(0x41, 0x25);  /* 81 */
-    paw_write(0x55, 0x18);  /* 82 */
-    paw_write(0x56, 0x14);  /* 83 */
-    paw_write(0x49, 0x0A);  /* 84 */
-    paw_write(0x42, 0x00);  /* 85 */
-    paw_write(0x43, 0x2D);  /* 86 */
-    paw_write(0x44, 0x0C);  /* 87 */
-    paw_write(0x54, 0x1A);  /* 88 */
-    paw_write(0x5A, 0x0D);  /* 89 */
-    paw_write(0x5F, 0x1E);  /* 90 */
-    paw_write(0x5B, 0x05);  /* 91 */
-    paw_write(0x5E, 0x0F);  /* 92 */
-    paw_write(0x7F, 0x0D);  /* 93 */
-    paw_write(0x48, 0xDD);  /* 94 */
-    paw_write(0x4F, 0x03);  /* 95 */
-    paw_write(0x52, 0x49);  /* 96 */
-    paw_write(0x51, 0x00);  /* 97 */
-    paw_write(0x54, 0x5B);  /* 98 */
-    paw_write(0x53, 0x00);  /* 99 */
-    paw_write(0x56, 0x64);  /* 100 */
-    paw_write(0x55, 0x00);  /* 101 */
-    paw_write(0x58, 0xA5);  /* 102 */
-    paw_write(0x57, 0x02);  /* 103 */
-    paw_write(0x5A, 0x29);  /* 104 */
-    paw_write(0x5B, 0x47);  /* 105 */
-    paw_write(0x5C, 0x81);  /* 106 */
-    paw_write(0x5D, 0x40);  /* 107 */
-    paw_write(0x71, 0xDC);  /* 108 */
-    paw_write(0x70, 0x07);  /* 109 */
-    paw_write(0x73, 0x00);  /* 110 */
-    paw_write(0x72, 0x08);  /* 111 */
-    paw_write(0x75, 0xDC);  /* 112 */
-    paw_write(0x74, 0x07);  /* 113 */
-    paw_write(0x77, 0x00);  /* 114 */
-    paw_write(0x76, 0x08);  /* 115 */
-    paw_write(0x7F, 0x10);  /* 116 */
-    paw_write(0x4C, 0xD0);  /* 117 */
-    paw_write(0x7F, 0x00);  /* 118 */
-    paw_write(0x4F, 0x63);  /* 119 */
-    paw_write(0x4E, 0x00);  /* 120 */
-    paw_write(0x52, 0x63);  /* 121 */
-    paw_write(0x51, 0x00);  /* 122 */
-    paw_write(0x54, 0x54);  /* 123 */
-    paw_write(0x5A, 0x10);  /* 124 */
-    paw_write(0x77, 0x4F);  /* 125 */
-    paw_write(0x47, 0x01);  /* 126 */
-    paw_write(0x5B, 0x40);  /* 127 */
-    paw_write(0x64, 0x60);  /* 128 */
-    paw_write(0x65, 0x06);  /* 129 */
-    paw_write(0x66, 0x13);  /* 130 */
-    paw_write(0x67, 0x0F);  /* 131 */
-    paw_write(0x78, 0x01);  /* 132 */
-    paw_write(0x79, 0x9C);  /* 133 */
-    paw_write(0x40, 0x00);  /* 134 */
-    paw_write(0x55, 0x02);  /* 135 */
-    paw_write(0x23, 0x70);  /* 136 */
-    paw_write(0x22, 0x01);  /* 137 */
-
-    delay_ms(1);            /* 138 */
-
-    /* 139 */
-    uint8_t val;
-    int i;
-    for (i = 0; i < 60; i++) {
-        val = paw_read(0x6C);
-        if (val == 0x80) {
-            break;
-        }
-        delay_ms(1);
-    }
-    if (i == 60) {
-        paw_write(0x7F, 0x14);  /* a */
-        paw_write(0x6C, 0x00);  /* b */
-        paw_write(0x7F, 0x00);  /* c */
+    if (POWER_ON_SEQUENCE) {
+        paw_run_sequence(paw3395_power_on_seq);
     }
 
-    paw_write(0x22, 0x00);  /* 140 */
-    paw_write(0x55, 0x00);  /* 141 */
-    paw_write(0x7F, 0x07);  /* 142 */
-    paw_write(0x40, 0x40);  /* 143 */
-    paw_write(0x7F, 0x00);  /* 144 */
-    paw_write(0x68, 0x01);  /* 145 */
-
-    #endif
-
     /* step 7 */
     (void)paw_read(0x02);
     (void)paw_read(0x03);
@@ -268,32 +584,110 @@ void paw_init(void) {
     (void)paw_read(0x06);
 
     /* disable rest mode */
-    paw_modify(PAW3395_PERFORMANCE, 0, PAW3395_PERFORMANCE_AWAKE_);
+    paw_set_rest(0);
 
     /* clear bit that causes inversion of X axis */
     paw_modify(PAW3395_AXIS_CONTROL, PAW3395_AXIS_CONTROL_INVX_, 0);
 
+    #if DBG >= 1
+    SEGGER_RTT_printf(0, "paw shadow mismatches: %d\n", paw_shadow_verify());
+    #endif
+
 }
 
 /* DPI must be a multiple of 50
  * min: 50, max: 26000
  */
 void paw_set_dpi(uint16_t dpi) {
+    paw_set_resolution(dpi, dpi);
+}
+
+/* round to the nearest 50 DPI step the sensor supports */
+static uint16_t paw_dpi_to_res(uint16_t dpi) {
 
-    uint16_t res     = dpi / 50;
-    uint8_t res_low  = (res >> 0) & 0x00FF;
-    uint8_t res_high = (res >> 8) & 0x00FF;
+    if (dpi < PAW3395_DPI_MIN) dpi = PAW3395_DPI_MIN;
+    if (dpi > PAW3395_DPI_MAX) dpi = PAW3395_DPI_MAX;
+
+    return (dpi + PAW3395_DPI_STEP / 2) / PAW3395_DPI_STEP;
+}
+
+/* X and Y are written first and only take effect together when SET_RES
+ * is raised, so the sensor never reports a frame with one axis updated
+ * and the other not. call this between motion bursts.
+ */
+void paw_set_resolution(uint16_t dpi_x, uint16_t dpi_y) {
+
+    uint16_t res_x = paw_dpi_to_res(dpi_x);
+    uint16_t res_y = paw_dpi_to_res(dpi_y);
 
     /* set dpi */
-    paw_write(PAW3395_RES_X_LOW,  res_low);
-    paw_write(PAW3395_RES_X_HIGH, res_high);
-    paw_write(PAW3395_RES_Y_LOW,  res_low);
-    paw_write(PAW3395_RES_Y_HIGH, res_high);
+    paw_write(PAW3395_RES_X_LOW,  (res_x >> 0) & 0x00FF);
+    paw_write(PAW3395_RES_X_HIGH, (res_x >> 8) & 0x00FF);
+    paw_write(PAW3395_RES_Y_LOW,  (res_y >> 0) & 0x00FF);
+    paw_write(PAW3395_RES_Y_HIGH, (res_y >> 8) & 0x00FF);
     paw_modify(PAW3395_SET_RESOLUTION, 0, PAW3395_SET_RESOLUTION_SET_RES_);
 
-    /* datasheet recommends for DPI >= 9000 */
-    if (dpi >= 9000) {
+    paw_dpi_x = res_x * PAW3395_DPI_STEP;
+    paw_dpi_y = res_y * PAW3395_DPI_STEP;
+
+    /* datasheet recommends for DPI >= 9000. clear it again when coming
+     * back down, now that the resolution can change at runtime */
+    if ((paw_dpi_x >= PAW3395_DPI_RIPPLE) || (paw_dpi_y >= PAW3395_DPI_RIPPLE)) {
         paw_modify(PAW3395_RIPPLE_CONTROL, 0, PAW3395_RIPPLE_CONTROL_CTRL8_);
     }
+    else {
+        paw_modify(PAW3395_RIPPLE_CONTROL, PAW3395_RIPPLE_CONTROL_CTRL8_, 0);
+    }
+
+}
+
+/* the resolution actually applied, after rounding */
+void paw_get_resolution(uint16_t *dpi_x, uint16_t *dpi_y) {
+    *dpi_x = paw_dpi_x;
+    *dpi_y = paw_dpi_y;
+}
+
+/* switch operating mode at runtime, without resetting the sensor.
+ * note the mode tables rewrite REST1 timing, so apply any custom
+ * `paw_set_rest_timing()` after this.
+ */
+void paw_set_mode(enum paw_mode mode) {
+
+    if (mode >= PAW_MODE_COUNT) {
+        return;
+    }
+
+    paw_run_sequence(paw3395_modes[mode]);
+    paw_modify(PAW3395_PERFORMANCE, PAW3395_PERFORMANCE_MODE_Msk, mode);
+    paw_mode = mode;
+
+}
+
+enum paw_mode paw_get_mode(void) {
+    return paw_mode;
+}
+
+/* rest mode lets the sensor downshift its frame rate when there's no motion.
+ * disabling it (AWAKE) keeps it in run mode permanently
+ */
+void paw_set_rest(uint8_t enable) {
+
+    if (enable) {
+        paw_modify(PAW3395_PERFORMANCE, PAW3395_PERFORMANCE_AWAKE_, 0);
+    }
+    else {
+        paw_modify(PAW3395_PERFORMANCE, 0, PAW3395_PERFORMANCE_AWAKE_);
+    }
+
+}
+
+void paw_set_rest_timing(const struct paw_rest_timing *timing) {
+
+    paw_write(PAW3395_RUN_DOWNSHIFT,   timing->run_downshift);
+    paw_write(PAW3395_REST1_PERIOD,    timing->rest1_period);
+    paw_write(PAW3395_REST1_DOWNSHIFT, timing->rest1_downshift);
+    paw_write(PAW3395_REST2_PERIOD,    timing->rest2_period);
+    paw_write(PAW3395_REST2_DOWNSHIFT, timing->rest2_downshift);
+    paw_write(PAW3395_REST3_PERIOD,    timing->rest3_period);
 
 }
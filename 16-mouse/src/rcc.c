@@ -8,6 +8,9 @@
 #include "device.h"
 #include "rcc.h"
 
+/* out of reset we run on HSI */
+uint32_t sysclk_hz = 8000000;
+
 void set_sysclk_72mhz(void) {
 
     /* enable HSE (8 MHz), loop until ready */
@@ -46,6 +49,8 @@ void set_sysclk_72mhz(void) {
     /* loop until SYSCLK source is PLL at hw level */
     while ((RCC->CFGR & RCC_CFGR_SWS_Msk) != RCC_CFGR_SWS_PLLCLK);
 
+    sysclk_hz = 72000000;
+
 }
 
 void set_sysclk_48mhz(void) {
@@ -86,4 +91,6 @@ void set_sysclk_48mhz(void) {
     /* loop until SYSCLK source is PLL at hw level */
     while ((RCC->CFGR & RCC_CFGR_SWS_Msk) != RCC_CFGR_SWS_PLLCLK);
 
+    sysclk_hz = 48000000;
+
 }
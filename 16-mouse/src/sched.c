@@ -0,0 +1,177 @@
+/**********************************************************************************
+ ** file         : sched.c
+ ** description  : run-to-completion event scheduler for the main loop
+ **
+ **                ISRs do the bare minimum and post an event, the main loop
+ **                runs the handler of the highest priority pending event,
+ **                to completion, and sleeps when there's nothing left.
+ **                handlers never preempt each other, so the order in which
+ **                work gets done only depends on the priorities.
+ **
+ **                sleeping is tickless: SysTick is stretched to the next
+ **                software timer that's due, so an idle mouse only wakes
+ **                up for interrupts and for timers.
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "device.h"
+#include "rcc.h"
+#include "dwt.h"
+#include "delay.h"
+#include "timer.h"
+#include "irq.h"
+#include "utils.h"
+#include "sched.h"
+
+static sched_handler handlers[SCHED_EV_COUNT];
+static struct sched_stats stats[SCHED_EV_COUNT];
+static struct idle_stats  idle;
+
+/* bit n set = event n pending. ISRs of any priority set bits and the main
+ * loop clears them, both with LDREX/STREX, so no interrupt masking is
+ * needed: a post that races with another post or a clear just retries */
+static volatile uint32_t ready;
+
+/* CYCCNT when the last WFI returned, and whether no ISR has claimed that
+ * wake-up yet (see `sched_woken()`) */
+static volatile uint32_t wake_stamp;
+static volatile uint32_t wake_armed;
+
+void sched_register(enum sched_event ev, sched_handler handler) {
+    handlers[ev] = handler;
+}
+
+/* safe from any ISR and from thread mode */
+void sched_post(enum sched_event ev) {
+    __atomic_fetch_or(&ready, 1u << ev, __ATOMIC_RELEASE);
+}
+
+/* sleep until an interrupt is pending. with interrupts masked, WFI still
+ * wakes on a pending one, and checking `ready` in between closes the race
+ * with an ISR posting right before we'd sleep.
+ *
+ * on the way out only SysTick (and below) is held off, with BASEPRI, until
+ * the timer wheel has caught up with the time slept. whatever woke us, a
+ * click or usb, runs right at the `cpsie` and doesn't wait for any of it */
+static void sched_idle(void) {
+
+    __asm__ volatile ("cpsid i" ::: "memory");
+
+    if (ready) {
+        __asm__ volatile ("cpsie i" ::: "memory");
+        return;
+    }
+
+    uint64_t start = time_us();
+
+    if (timer_sleep_begin() > 1) {
+        idle.tickless++;
+    }
+
+    __asm__ volatile ("wfi");
+    wake_stamp = now_cycles();
+    wake_armed = 1;
+
+    uint32_t basepri = irq_mask(IRQ_PRIO_SYSTICK);
+
+    /* pending ISRs above SysTick are taken here, the isb makes sure it's
+     * before the disarm: an ISR after that isn't the one that woke us */
+    __asm__ volatile ("cpsie i\n\tisb" ::: "memory");
+    wake_armed = 0;
+
+    timer_sleep_end();
+
+    idle.sleeps++;
+    idle.asleep_us += time_us() - start;
+
+    irq_unmask(basepri);
+
+}
+
+/* called at the entry of the ISRs that can end a sleep (buttons, usb) with
+ * the CYCCNT they read there. the first one after a WFI records how long it
+ * took to get from the WFI to it. the ISRs nest, so claim it atomically */
+RAMFUNC void sched_woken(uint32_t now) {
+
+    if (!__atomic_exchange_n(&wake_armed, 0, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    uint32_t cycles = now - wake_stamp;
+
+    idle.irq_wakes++;
+    if (cycles > idle.irq_wake_max_cycles) {
+        idle.irq_wake_max_cycles = cycles;
+    }
+
+}
+
+static void sched_dispatch(enum sched_event ev) {
+
+    uint32_t start = now_cycles();
+
+    handlers[ev]();
+
+    uint32_t cycles = now_cycles() - start;
+
+    stats[ev].runs++;
+    if (cycles > stats[ev].max_cycles) {
+        stats[ev].max_cycles = cycles;
+    }
+    if (cycles > SCHED_BUDGET_US * (sysclk_hz / 1000000)) {
+        stats[ev].overruns++;
+    }
+
+}
+
+void sched_run(void) {
+
+    for (;;) {
+
+        sched_idle();
+
+        /* re-read after every handler: whatever got posted meanwhile
+         * competes by priority with what was already pending */
+        uint32_t pending;
+        while ((pending = ready)) {
+
+            uint32_t ev = __builtin_ctz(pending);
+
+            /* clear before running, so a post during the handler isn't lost */
+            __atomic_fetch_and(&ready, ~(1u << ev), __ATOMIC_ACQUIRE);
+
+            if (handlers[ev]) {
+                sched_dispatch(ev);
+            }
+        }
+    }
+
+}
+
+void sched_get_stats(struct sched_stats *out) {
+    memcpy(out, stats, sizeof(stats));
+}
+
+void sched_reset_stats(void) {
+    memset(stats, 0, sizeof(stats));
+}
+
+void sched_get_idle_stats(struct idle_stats *out) {
+
+    uint32_t wakes, wake_max, tick_max;
+
+    timer_get_wake_stats(&wakes, &wake_max, &tick_max);
+
+    *out = idle;
+    out->wakes           = wakes;
+    out->wake_max_cycles = wake_max;
+    out->tick_max_cycles = tick_max;
+
+}
+
+void sched_reset_idle_stats(void) {
+    memset(&idle, 0, sizeof(idle));
+    timer_reset_wake_stats();
+}
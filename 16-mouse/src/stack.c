@@ -0,0 +1,33 @@
+/**********************************************************************************
+ ** file         : stack.c
+ ** description  : stack reserve high-water mark
+ **
+ **                `reset_handler()` fills the reserve (`_sstack` to the stack
+ **                pointer) with STACK_PAINT. the stack grows down, so the
+ **                lowest word that isn't paint anymore is the deepest it
+ **                has been. a value that happens to equal the paint makes it
+ **                read one word short at worst.
+ **
+ **                the static counterpart is `make stack`, which reports the
+ **                worst case per entry point from the call graph.
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include "stack.h"
+
+extern uint32_t _sstack;
+extern uint32_t _estack;
+
+void stack_get(struct stack_stats *stats) {
+
+    const uint32_t *p = &_sstack;
+
+    while (p < &_estack && *p == STACK_PAINT) {
+        p++;
+    }
+
+    stats->reserve  = (&_estack - &_sstack) * 4;
+    stats->used_max = (&_estack - p) * 4;
+
+}
@@ -1,33 +1,73 @@
 /********************************************************************
  ** file         : startup.c
- ** description  : copy .data, zero .bss, branch to main()
+ ** description  : start the cycle counter, copy .data, zero .bss,
+ **                paint the stack reserve, branch to main()
  **
  **
  ********************************************************************/
 
 #include <stdint.h>
+#include "device.h"
+#include "boot.h"
+#include "stack.h"
 
 extern int main(void);
 extern uint32_t _estack;
-extern uint32_t _etext;
+extern uint32_t _sidata;
 extern uint32_t _sdata;
 extern uint32_t _edata;
 extern uint32_t _sbss;
 extern uint32_t _ebss;
+extern uint32_t _sstack;
 
 void reset_handler(void) {
-    
-    uint32_t *src = &_etext;
+
+    /* first thing: from here on CYCCNT is the time since reset (boot.c) */
+    COREDEBUG->DEMCR |= COREDEBUG_DEMCR_TRCENA_;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_;
+
+    /* 16 bytes per LDM/STM pair, and one loop compare per 16 bytes instead
+     * of per word. then whatever is left one word at a time */
+    uint32_t *src = &_sidata;
     uint32_t *dst = &_sdata;
+    while (&_edata - dst >= 4) {
+        __asm__ volatile ("ldmia %[src]!, {r3, r4, r5, r6}\n\t"
+                          "stmia %[dst]!, {r3, r4, r5, r6}"
+                          : [src] "+r" (src), [dst] "+r" (dst)
+                          :: "r3", "r4", "r5", "r6", "memory");
+    }
     while (dst < &_edata) {
         *dst++ = *src++;
     }
 
     dst = &_sbss;
+    uint32_t blocks = (&_ebss - dst) / 4;
+    if (blocks) {
+        __asm__ volatile ("movs r3, #0\n\t"
+                          "movs r4, #0\n\t"
+                          "movs r5, #0\n\t"
+                          "movs r6, #0\n"
+                          "1:\n\t"
+                          "stmia %[dst]!, {r3, r4, r5, r6}\n\t"
+                          "subs %[n], %[n], #1\n\t"
+                          "bne 1b"
+                          : [dst] "+r" (dst), [n] "+r" (blocks)
+                          :: "r3", "r4", "r5", "r6", "cc", "memory");
+    }
     while (dst < &_ebss) {
         *dst++ = 0;
     }
 
+    /* everything below our own frame. ~512 words for the default 2K */
+    uint32_t *sp;
+    __asm__ volatile ("mov %0, sp" : "=r" (sp));
+    for (dst = &_sstack; dst < sp; dst++) {
+        *dst = STACK_PAINT;
+    }
+
+    boot_mark(BOOT_MAIN);
+
     main();
 
     for(;;);
@@ -0,0 +1,353 @@
+/**********************************************************************************
+ ** file         : timer.c
+ ** description  : software timers on a two-level timer wheel, ticked by SysTick
+ **
+ **                every slot is a list of the timers that expire in it, so
+ **                start and stop are O(1) and a tick only looks at one near
+ **                slot. once per lap of the near wheel (256 ticks) the next
+ **                far slot is emptied into the near wheel.
+ **
+ **                a tick therefore costs the timers that expire on it, plus,
+ **                every 256th, the ones filed in that far slot. it never
+ **                depends on how many timers are armed in total.
+ **
+ **                when the main loop goes to sleep, ticks that have nothing
+ **                to do are skipped: SysTick is stretched to fire right at
+ **                the next one that does (see TICKLESS IDLE).
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "device.h"
+#include "rcc.h"
+#include "utils.h"
+#include "irq.h"
+#include "timer.h"
+
+#define NEAR_SIZE   (1 << TIMER_NEAR_BITS)
+#define NEAR_MASK   (NEAR_SIZE - 1)
+#define FAR_SIZE    (1 << TIMER_FAR_BITS)
+#define FAR_MASK    (FAR_SIZE - 1)
+
+static struct timer *near[NEAR_SIZE];
+static struct timer *far[FAR_SIZE];
+
+/* the tick being (or last) processed. written by the ISR, and by
+ * `timer_sleep_end()` with interrupts masked */
+static volatile uint32_t ticks;
+
+/* SysTick cycles per tick */
+static uint32_t tick_cycles;
+
+/* ticks covered by the SysTick period in progress, 1 unless sleeping */
+static uint32_t stretch = 1;
+
+/* the next tick ISR ends a stretched sleep */
+static uint8_t tick_wakes;
+
+/* tick -> ISR entry latency, after a stretched sleep and otherwise */
+static uint32_t wakes;
+static uint32_t wake_max_cycles;
+static uint32_t tick_max_cycles;
+
+/* --- CRITICAL SECTIONS ------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* start/stop from thread mode race with the ISR walking the same lists,
+ * so they briefly mask SysTick (and whatever is below it), higher priority
+ * ISRs keep running. from a callback the mask is already moot. this is also
+ * why the higher priority ISRs must not touch timers */
+
+/* --- WHEEL ------------------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+static void timer_link(struct timer **slot, struct timer *t) {
+    t->next = *slot;
+    if (t->next) {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = slot;
+    *slot = t;
+}
+
+static void timer_unlink(struct timer *t) {
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    t->next  = NULL;
+    t->pprev = NULL;
+}
+
+/* file `t` by how far away it is from the current tick.
+ *
+ * the near slot is simply the low bits of `expires`, any delta below
+ * NEAR_SIZE lands in a slot that comes up before the wheel wraps. a delta of
+ * 0 is only seen while re-filing, and lands in the slot about to be run.
+ *
+ * further out, the far slot is picked the same way from the next bits up.
+ * its slot gets emptied at the start of the lap containing `expires`, which
+ * is never late. beyond the far wheel's range the timer goes in the slot
+ * emptied last, and simply gets re-filed until it's in range */
+static void timer_file(struct timer *t) {
+
+    uint32_t delta = t->expires - ticks;
+
+    if (delta < NEAR_SIZE) {
+        timer_link(&near[t->expires & NEAR_MASK], t);
+    }
+    else if (delta < NEAR_SIZE * FAR_SIZE) {
+        timer_link(&far[(t->expires >> TIMER_NEAR_BITS) & FAR_MASK], t);
+    }
+    else {
+        timer_link(&far[((ticks >> TIMER_NEAR_BITS) - 1) & FAR_MASK], t);
+    }
+
+}
+
+static void timer_cascade(void) {
+
+    struct timer **slot = &far[(ticks >> TIMER_NEAR_BITS) & FAR_MASK];
+    struct timer *t;
+
+    while ((t = *slot)) {
+        timer_unlink(t);
+        timer_file(t);
+    }
+
+}
+
+void systick_handler(void) {
+
+    /* RVR always holds one tick when the counter reloads (see below), so
+     * this is how long ago the tick happened */
+    uint32_t latency = (tick_cycles - 1) - STK->CVR;
+
+    /* reading CSR clears COUNTFLAG: from here on it means a tick is pending */
+    (void)STK->CSR;
+
+    if (tick_wakes) {
+        tick_wakes = 0;
+        wakes++;
+        if (latency > wake_max_cycles) wake_max_cycles = latency;
+    }
+    else {
+        if (latency > tick_max_cycles) tick_max_cycles = latency;
+    }
+
+    ticks++;
+
+    if ((ticks & NEAR_MASK) == 0) {
+        timer_cascade();
+    }
+
+    /* take them off one at a time: a callback may stop or restart any timer,
+     * including the next one in this slot. anything (re)started here has a
+     * delay of at least 1 tick, so this slot can't refill */
+    struct timer **slot = &near[ticks & NEAR_MASK];
+    struct timer *t;
+
+    while ((t = *slot)) {
+        timer_unlink(t);
+        if (t->period) {
+            t->expires += t->period;
+            timer_file(t);
+        }
+        t->callback(t->arg);
+    }
+
+}
+
+/* --- TICKLESS IDLE ----------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+/* called by the scheduler right before its WFI with interrupts masked, and
+ * right after it with SysTick (and below) masked by BASEPRI. no ISR that
+ * touches timers ever sees a stretched tick, the ones above SysTick keep
+ * running, except for the few cycles around the counter read and reload.
+ *
+ * SysTick can't be re-timed on the fly: RVR only applies at the next
+ * reload. so we load the long period by writing CVR (which zeroes the
+ * counter and reloads on the next clock, without an interrupt), wait for
+ * the reload, then put one tick back in RVR for every period after it.
+ * the few cycles spent doing that are lost each time; these ticks schedule
+ * work, time_us() is the clock. */
+
+/* smallest period worth loading, too short and the reload wait could miss it */
+#define MIN_PERIOD_CYCLES   32
+
+/* closer than this to the end of a period, we leave the counter alone: it
+ * could hit 0 before our CVR write, and the tick would be counted twice.
+ * only holds while nothing can preempt between the read and the write */
+#define GUARD_CYCLES        64
+
+static void tick_load(uint32_t cycles) {
+
+    STK->RVR = MAX(cycles, MIN_PERIOD_CYCLES) - 1;
+    STK->CVR = 0;
+    while (STK->CVR == 0);
+    STK->RVR = tick_cycles - 1;
+
+}
+
+/* ticks until the next one with work: a timer in its near slot, or a far
+ * slot to empty. capped by what fits in SysTick's 24 bits (233ms at 72MHz) */
+static uint32_t ticks_idle(void) {
+
+    uint32_t max = MIN((STK_RVR_RELOAD_Msk + 1) / tick_cycles, NEAR_SIZE);
+    uint32_t n;
+
+    for (n = 1; n < max; n++) {
+        uint32_t tick = ticks + n;
+        if (near[tick & NEAR_MASK] || (tick & NEAR_MASK) == 0) {
+            break;
+        }
+    }
+
+    return n;
+
+}
+
+/* returns how many ticks the sleep may last, 1 if it's not stretched */
+uint32_t timer_sleep_begin(void) {
+
+    uint32_t n = ticks_idle();
+    if (n == 1) {
+        return 1;
+    }
+
+    /* CVR first: if the counter wrapped before we read it, COUNTFLAG read
+     * after it is set, the tick is pending and the WFI will return at once */
+    uint32_t left = STK->CVR;
+    if ((STK->CSR & STK_CSR_COUNTFLAG_) || left < GUARD_CYCLES) {
+        return 1;
+    }
+
+    /* end the period where tick `ticks + n` would have */
+    tick_load(left + (n - 1) * tick_cycles);
+    stretch = n;
+
+    return n;
+
+}
+
+void timer_sleep_end(void) {
+
+    if (stretch == 1) {
+        return;
+    }
+
+    /* an ISR between reading the counter and reloading it would base the
+     * reload on a stale count, so hold everything off for these few dozen
+     * cycles. whatever woke us has already run by now */
+    __asm__ volatile ("cpsid i" ::: "memory");
+
+    uint32_t left = STK->CVR;
+    uint32_t done = STK->CSR & STK_CSR_COUNTFLAG_;
+
+    if (!done && left < GUARD_CYCLES) {
+        while (!(STK->CSR & STK_CSR_COUNTFLAG_));
+        done = 1;
+    }
+
+    if (done) {
+        /* slept all the way: the ISR (pending) does the last tick */
+        ticks += stretch - 1;
+        tick_wakes = 1;
+    }
+    else {
+        /* woken early. the period ends on a tick boundary, so the boundaries
+         * still ahead of us are every `tick_cycles` back from its end */
+        uint32_t ahead = (left - 1) / tick_cycles;
+
+        ticks += stretch - 1 - ahead;
+        tick_load(left - ahead * tick_cycles);
+    }
+
+    stretch = 1;
+
+    __asm__ volatile ("cpsie i" ::: "memory");
+
+}
+
+void timer_get_wake_stats(uint32_t *wake_count, uint32_t *wake_max, uint32_t *tick_max) {
+    *wake_count = wakes;
+    *wake_max   = wake_max_cycles;
+    *tick_max   = tick_max_cycles;
+}
+
+void timer_reset_wake_stats(void) {
+    wakes           = 0;
+    wake_max_cycles = 0;
+    tick_max_cycles = 0;
+}
+
+/* --- API --------------------------------------------------------------------------- */
+/* ----------------------------------------------------------------------------------- */
+
+void timer_init(void) {
+
+    tick_cycles = sysclk_hz / TIMER_TICK_HZ;
+
+    /* systick clock = AHB = 72MHz */
+    STK->CSR |= STK_CSR_CLKSOURCE_AHBDIV;
+
+    /* set reload to N-1 since interrupt happens every N clock pulses */
+    STK->RVR = (tick_cycles - 1) & STK_RVR_RELOAD_Msk;
+
+    /* clear the current counter value, which is unpredictable at reset */
+    STK->CVR = 0;
+
+    SCB->SHPR[SCB_SHPR_SYSTICK] = IRQ_PRIO_SYSTICK << (8 - NVIC_PRIO_BITS);
+
+    /* enable systick interrupt, enable counter */
+    STK->CSR |= STK_CSR_TICKINT_ | STK_CSR_ENABLE_;
+
+}
+
+/* ms since `timer_init()` at the default rate, wraps after ~49 days */
+uint32_t timer_ticks(void) {
+    return ticks;
+}
+
+void timer_setup(struct timer *t, timer_callback callback, void *arg) {
+    t->next     = NULL;
+    t->pprev    = NULL;
+    t->callback = callback;
+    t->arg      = arg;
+}
+
+/* (re)arm `t` to fire in `delay` ticks (0 is taken as 1), then every
+ * `period` ticks if that's not 0 */
+void timer_start(struct timer *t, uint32_t delay, uint32_t period) {
+
+    uint32_t basepri = irq_mask(IRQ_PRIO_SYSTICK);
+
+    if (t->pprev) {
+        timer_unlink(t);
+    }
+
+    t->expires = ticks + (delay ? delay : 1);
+    t->period  = period;
+    timer_file(t);
+
+    irq_unmask(basepri);
+
+}
+
+void timer_stop(struct timer *t) {
+
+    uint32_t basepri = irq_mask(IRQ_PRIO_SYSTICK);
+
+    if (t->pprev) {
+        timer_unlink(t);
+    }
+
+    irq_unmask(basepri);
+
+}
+
+int timer_pending(const struct timer *t) {
+    return t->pprev != NULL;
+}
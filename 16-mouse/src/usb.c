@@ -9,6 +9,8 @@
 #include <stddef.h>
 #include "device.h"
 #include "gpio.h"
+#include "dwt.h"
+#include "irq.h"
 #include "utils.h"
 #include "usb.h"
 #include "usb_ep0.h"
@@ -27,7 +29,7 @@ uint16_t pma_top;
 /* ----------------------------------------------------------------------------------- */
 
 void usb_enable_isr(void) {
-    NVIC->ISER[NVIC_USB_LP_CAN_RX0_IRQ / 32] = (1 << (NVIC_USB_LP_CAN_RX0_IRQ % 32));
+    irq_enable(NVIC_USB_LP_CAN_RX0_IRQ);
 }
 
 usb_device * usb_init(const struct usb_device_descriptor *dev_desc, 
@@ -49,6 +51,8 @@ usb_device * usb_init(const struct usb_device_descriptor *dev_desc,
 
     usb_dev->user_set_config_callback = NULL;
 
+    irq_set_priority(NVIC_USB_LP_CAN_RX0_IRQ, IRQ_PRIO_USB);
+
     for (int i = 0; i < MAX_USER_EP0_REQ_HANDLER; i++) {
         usb_dev->user_ep0_req_handler[i].cb = NULL;
     }
@@ -67,9 +71,7 @@ void usb_start(usb_device *dev) {
     RCC->APB2ENR |= RCC_APB2ENR_IOPAEN_;
     GPIOA->CRH = (GPIOA->CRH & ~(GPIO_CRH_CNFMODE12_Msk)) | (GPIO_CNFMODE_OUTPUT_GP_OPENDRAIN_2MHZ << GPIO_CRH_CNFMODE12_Shft);
     gpio_clear(GPIOA, GPIO12);
-    for (uint32_t i = 0; i < 800000; i++) {
-        __asm__("nop");
-    }
+    delay_cycles(sysclk_hz / 50);    /* 20ms */
     gpio_set(GPIOA, GPIO12);
 
     /* enable usb clock, take over D+ and D- pins (rm0008 p.168 t.29) */
@@ -238,7 +240,7 @@ void usb_ep_set_clr_nak(usb_device *dev, uint8_t addr, uint8_t nak) {
 
 }
 
-static void usb_write_to_pma(volatile void *pma_dest, const void *buf, uint16_t len) {
+RAMFUNC static void usb_write_to_pma(volatile void *pma_dest, const void *buf, uint16_t len) {
 
     const uint16_t *lbuf = buf;    /* local copy of buf where data is broken up into 16-bit chunks */
     volatile uint32_t *pma = pma_dest;   
@@ -271,7 +273,65 @@ uint16_t usb_ep_write_packet(usb_device *dev, uint8_t addr, const void *buf, uin
     return len;
 }
 
-static void usb_read_from_pma(void *buf, const volatile void *pma_src, uint16_t len) {
+/* overwrite part of a packet that's already queued (VALID) on an IN endpoint,
+ * for data that changed after the packet was written. returns 0xffff if
+ * there's nothing queued, or if the packet was collected while we were at
+ * it: the caller has to get the data out the normal way then.
+ *
+ * the host is NAK'd while the buffer is inconsistent. the STAT bits are
+ * toggle-on-write, so if the hardware completes a transfer (setting NAK
+ * itself) inside one of our read-modify-writes, our "VALID -> NAK" toggle
+ * turns it back into VALID. CTR_TX tells us that happened, so it's checked
+ * after each write and NAK is restored.
+ *
+ * not reentrant with `usb_ep_write_packet()` on the same endpoint, but that
+ * only runs once the hardware has set NAK, and this backs off on NAK.
+ */
+uint16_t usb_ep_patch_packet(usb_device *dev, uint8_t addr, uint16_t offset, const void *buf, uint16_t len) {
+
+    (void)dev;
+    uint8_t ep = addr & 0b01111111;
+    const uint8_t *bbuf = buf;
+    volatile uint32_t *pma = (volatile uint32_t *)USB_GET_PMA_EP_TX_BUFF(ep);
+
+    if ((USB->EPR[ep] & USB_EPR_STAT_TX_Msk) != USB_EPR_STAT_TX_VALID) {
+        return 0xffff;
+    }
+
+    /* hold off the host */
+    USB_SET_EPR_STAT_TX(ep, USB_EPR_STAT_TX_NAK);
+
+    /* collected between the check and the NAK */
+    if (USB->EPR[ep] & USB_EPR_CTR_TX_Msk) {
+        USB_SET_EPR_STAT_TX(ep, USB_EPR_STAT_TX_NAK);
+        return 0xffff;
+    }
+
+    /* pma is 16-bit words on a 32-bit stride, patch byte by byte */
+    for (uint16_t i = offset; i < offset + len; i++) {
+        uint16_t half = pma[i >> 1];
+        if (i & 1) {
+            half = (half & 0x00FF) | (*bbuf++ << 8);
+        }
+        else {
+            half = (half & 0xFF00) | (*bbuf++ << 0);
+        }
+        pma[i >> 1] = half;
+    }
+
+    USB_SET_EPR_STAT_TX(ep, USB_EPR_STAT_TX_VALID);
+
+    /* a transfer that was already on the wire when we NAK'd finishes now:
+     * undo the VALID, what we patched never went out */
+    if (USB->EPR[ep] & USB_EPR_CTR_TX_Msk) {
+        USB_SET_EPR_STAT_TX(ep, USB_EPR_STAT_TX_NAK);
+        return 0xffff;
+    }
+
+    return len;
+}
+
+RAMFUNC static void usb_read_from_pma(void *buf, const volatile void *pma_src, uint16_t len) {
 
     uint16_t *lbuf = buf;
     const volatile uint32_t *pma = pma_src;
@@ -376,7 +436,7 @@ static void usb_reset(usb_device *dev) {
 
 }
 
-static void usb_ctr(usb_device *dev, uint16_t istr) {
+RAMFUNC static void usb_ctr(usb_device *dev, uint16_t istr) {
 
     uint8_t ep = istr & USB_ISTR_EP_ID_Msk;
     uint8_t type;
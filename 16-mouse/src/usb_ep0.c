@@ -315,14 +315,57 @@ void _usb_ep0_setup(usb_device *dev, uint8_t ep) {
     }
     else {
 
-        /* host wants to send data stages to us over ep0. there's rly no
-         * good reason for this to happen so we just stall.
-         *
-         * the only std req that requires this is SET_DESCRIPTOR, which
-         * is officially optional and would never happen. otherwise, we'll
-         * just assume any vendor-specific data that you wanna send from the
-         * host over ep0 can fit in the setup data (req->wIndex, req->wValue)
+        /* host wants to send data stages to us over ep0, e.g. HID SET_REPORT.
+         * collect them in `ctrl_buf` first, the request is handled once all
+         * of it is in. anything bigger than the buffer gets stalled, it
+         * would have no business being sent to a mouse anyway
          */
+        if (req->wLength > sizeof(dev->ep0.ctrl_buf)) {
+            stall_transaction(dev);
+            return;
+        }
+
+        dev->ep0.xfer_buf = dev->ep0.ctrl_buf;
+        dev->ep0.xfer_len = 0;
+        dev->ep0.stage    = USB_DATA_OUT;
+
+        /* clear NAK to enable reception of the first data packet */
+        usb_ep_set_clr_nak(dev, 0, 0);
+    }
+}
+
+/* one OUT data packet has arrived. once we have wLength bytes (or a short
+ * packet), hand the lot to the request handlers: `*buf` points at the data
+ * and `*len` is how much of it there is.
+ */
+static void usb_ep0_data_out(usb_device *dev) {
+
+    struct usb_setup_data *req = &(dev->ep0.req);
+    uint16_t left = req->wLength - dev->ep0.xfer_len;
+    uint16_t len;
+
+    len = usb_ep_read_packet(dev, 0, dev->ep0.ctrl_buf + dev->ep0.xfer_len, left);
+    if (len == 0xffff) {
+        stall_transaction(dev);
+        return;
+    }
+    dev->ep0.xfer_len += len;
+
+    if ((len == dev->dev_desc->bMaxPacketSize0) && (dev->ep0.xfer_len < req->wLength)) {
+        /* more to come, rx was left VALID by the read */
+        return;
+    }
+
+    /* no more OUT packets until the next setup */
+    usb_ep_set_clr_nak(dev, 0, 1);
+
+    dev->ep0.xfer_buf = dev->ep0.ctrl_buf;
+
+    if (usb_ep0_handle_request(dev, req) == USB_REQ_HANDLED) {
+        usb_prepare_for_status(dev, USB_STATUS_IN);
+        dev->ep0.stage = USB_STATUS_IN;
+    }
+    else {
         stall_transaction(dev);
     }
 }
@@ -374,6 +417,15 @@ void _usb_ep0_out(usb_device *dev, uint8_t ep) {
 
     switch (dev->ep0.stage) {
 
+        case USB_DATA_OUT:
+
+            #if DBG >= 1
+            SEGGER_RTT_printf(0, "    DATA_OUT\n");
+            #endif
+
+            usb_ep0_data_out(dev);
+            break;
+
         case USB_STATUS_OUT:
 
             #if DBG >= 1
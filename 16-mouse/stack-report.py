@@ -0,0 +1,237 @@
+#!/usr/bin/env python3
+#####################################################################
+## file         : stack-report.py
+## description  : worst-case stack per entry point, from the .ci call
+##                graphs gcc writes with -fstack-usage -fcallgraph-info=su
+##
+## usage        : python3 stack-report.py [--reserve BYTES] [--irq FILE]
+##                                         [--src DIR] build/*.ci
+##                (or just `make stack`)
+##
+## every function's frame comes from gcc, the worst case of an entry
+## point is its frame plus that of its deepest callee, recursively.
+##
+## entry points: main, reset_handler, and the ISRs (*_isr, *_handler)
+## that nothing calls. functions nothing calls directly but whose name
+## shows up in the sources other than as a call are taken to be called
+## through pointers (usb callbacks, sched handlers, timer callbacks, ...):
+## an indirect call counts as the deepest of them. that's pessimistic, and
+## since those can call through pointers again, only INDIRECT_DEPTH levels
+## of it are followed. recursion makes a path unbounded and is reported as
+## such.
+##
+## ISRs run on the same stack (MSP) and each one taken adds an exception
+## frame. ISRs of equal priority can't nest, so the total is the thread
+## plus, for every priority level, the deepest ISR at that level. levels
+## are the IRQ_PRIO_* values read from irq.h, ISR_PRIO says which ISR runs
+## at which of them. an ISR missing from it gets a level of its own, which
+## can only make the total larger.
+#####################################################################
+
+import argparse
+import glob
+import os
+import re
+import sys
+
+# 8 words pushed on entry, plus one of padding if the SP gets realigned to 8
+EXCEPTION_FRAME = 36
+
+NODE = re.compile(r'node: \{ title: "([^"]+)" label: "([^"]*)"')
+EDGE = re.compile(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+SIZE = re.compile(r'\\n(\d+) bytes \(([^)]*)\)')
+
+COMMENT = re.compile(r'/\*.*?\*/|//[^\n]*', re.S)
+
+# ISR name -> the IRQ_PRIO_* it's given (irq.h, and the *_setup()s that
+# call `irq_set_priority()`)
+ISR_PRIO = [
+    (re.compile(r'exti\d+(_\d+)?_isr$'),  "IRQ_PRIO_BUTTONS"),
+    (re.compile(r'dma1_channel6_isr$'),    "IRQ_PRIO_BUTTONS"),
+    (re.compile(r'tim2_isr$'),             "IRQ_PRIO_TIMEBASE"),
+    (re.compile(r'usb_lp_can_rx0_isr$'),   "IRQ_PRIO_USB"),
+    (re.compile(r'systick_handler$'),      "IRQ_PRIO_SYSTICK"),
+]
+
+PRIO_DEFINE = re.compile(r'^#define\s+(IRQ_PRIO_\w+)\s+(\d+)', re.M)
+
+INDIRECT = "__indirect_call"
+INDIRECT_DEPTH = 2
+
+
+def parse(paths):
+
+    frames  = {}        # name -> bytes
+    dynamic = set()     # names with a non-static frame (VLA, alloca)
+    calls   = {}        # name -> set of callee names
+
+    for path in paths:
+        with open(path) as f:
+            text = f.read()
+
+        for title, label in NODE.findall(text):
+            m = SIZE.search(label)
+            if m is None:
+                continue    # only declared in this file
+            # static functions of the same name in two files: keep the larger
+            frames[title] = max(frames.get(title, 0), int(m.group(1)))
+            if m.group(2) != "static":
+                dynamic.add(title)
+
+        for src, dst in EDGE.findall(text):
+            calls.setdefault(src, set()).add(dst)
+
+    return frames, dynamic, calls
+
+
+def address_taken(names, src):
+
+    """names (file-qualified for statics) that appear in a source file other
+    than as a call or declaration, e.g. passed or stored as a pointer"""
+
+    text = ""
+    for path in glob.glob(os.path.join(src, "**", "*.c"), recursive=True):
+        with open(path, errors="replace") as f:
+            text += COMMENT.sub(" ", f.read())
+
+    taken = set()
+    for name in names:
+        bare = name.split(":")[-1]
+        if re.search(r'\b' + re.escape(bare) + r'\b(?!\s*\()', text):
+            taken.add(name)
+
+    return taken
+
+
+def priorities(path):
+
+    """IRQ_PRIO_* name -> level, from irq.h"""
+
+    if not path:
+        return {}
+    with open(path) as f:
+        return {name: int(level) for name, level in PRIO_DEFINE.findall(f.read())}
+
+
+def isr_level(name, prios):
+
+    """priority level of an ISR, or the ISR itself as a level of its own"""
+
+    for pattern, prio in ISR_PRIO:
+        if pattern.match(name) and prio in prios:
+            return prios[prio]
+    return name
+
+
+def is_entry(name):
+    return name in ("main", "reset_handler") or name.endswith("_isr") or name.endswith("_handler")
+
+
+def main():
+
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--reserve", type=int, default=0, help="stack reserve in bytes (linker script)")
+    ap.add_argument("--irq", help="irq.h with the IRQ_PRIO_* levels (without: all ISRs may nest)")
+    ap.add_argument("--src", default="src", help="sources, to find functions used as pointers")
+    ap.add_argument("files", nargs="+")
+    args = ap.parse_args()
+
+    frames, dynamic, calls = parse(args.files)
+    prios = priorities(args.irq)
+
+    called = set()
+    for callees in calls.values():
+        called |= callees
+
+    entries  = sorted(n for n in frames if is_entry(n) and n not in called)
+    indirect = sorted(address_taken([n for n in frames if n not in called and not is_entry(n)], args.src))
+
+    memo    = {}
+    unknown = set()
+
+    # (bytes, path), bytes is None if unbounded. `level` is how many indirect
+    # calls deep we are
+    def worst(name, stack, level=0):
+
+        key = (name, level)
+        if key in memo:
+            return memo[key]
+        if key in stack:
+            return (None, [name + " (recursion)"])
+
+        if name == INDIRECT:
+            if level == INDIRECT_DEPTH:
+                return (0, ["(indirect, not followed)"])
+            targets = indirect
+            frame = 0
+            level += 1
+        elif name in frames:
+            targets = calls.get(name, ())
+            frame = frames[name]
+        else:
+            unknown.add(name)   # assembly, libgcc, ...
+            return (0, [name + " (?)"])
+
+        stack.add(key)
+        best = (0, [])
+        for callee in targets:
+            depth, path = worst(callee, stack, level)
+            if depth is None:
+                best = (None, path)
+                break
+            if depth > best[0]:
+                best = (depth, path)
+        stack.discard(key)
+
+        if best[0] is None:
+            result = (None, [name] + best[1])
+        else:
+            result = (frame + best[0], ([name] if name != INDIRECT else ["(indirect)"]) + best[1])
+
+        memo[key] = result
+        return result
+
+    print("%-28s %8s   %s" % ("entry point", "bytes", "deepest path"))
+    print("-" * 78)
+
+    # the thread stack starts at reset_handler, which main() is called from
+    thread  = "reset_handler" if "reset_handler" in entries else "main"
+    total   = 0
+    levels  = {}        # level -> deepest ISR there, frame included
+    bounded = True
+    for name in entries:
+        depth, path = worst(name, set())
+        flag = " (dynamic frames)" if any(p in dynamic for p in path) else ""
+        if depth is None:
+            bounded = False
+            print("%-28s %8s   %s" % (name, "unbounded", " > ".join(path)))
+            continue
+        if name == thread:
+            total += depth
+        else:
+            level = isr_level(name, prios)
+            levels[level] = max(levels.get(level, 0), depth + EXCEPTION_FRAME)
+        print("%-28s %8d   %s%s" % (name, depth, " > ".join(path), flag))
+
+    total += sum(levels.values())
+
+    print("-" * 78)
+    if unknown:
+        print("no stack info (counted as 0): " + ", ".join(sorted(unknown)))
+    if not bounded:
+        print("worst case: unbounded (recursion)")
+        return 1
+
+    print("worst case, %s + the deepest ISR of each of %d priority levels (+%d bytes frame each): %d bytes"
+          % (thread, len(levels), EXCEPTION_FRAME, total))
+
+    if args.reserve:
+        print("reserve: %d bytes, %s" % (args.reserve, "ok" if total <= args.reserve else "TOO SMALL"))
+        if total > args.reserve:
+            return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,248 @@
+/**********************************************************************************
+ ** file         : motion_test.c
+ ** description  : host test for the motion stage: runs `motion_apply()` over
+ **                a sweep of angles and curves and checks the accumulated
+ **                output against a double-precision reference.
+ **
+ ** usage        : make test
+ **
+ **********************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include "motion.h"
+
+/* per-frame motion patterns. slow ones are where rounding drift would show,
+ * fast ones are where the table error would */
+struct pattern {
+    const char *name;
+    int16_t     dx;
+    int16_t     dy;
+    int         frames;
+};
+
+static const struct pattern patterns[] = {
+    { "slow x",         1,     0, 20000 },
+    { "slow diagonal",  1,     1, 20000 },
+    { "slow steep",     1,    -3, 20000 },
+    { "medium",        37,   -11,  5000 },
+    { "fast",        1200,   700,  2000 },
+    { "fast back",  -9000,  4000,   200 },
+};
+
+#define PATTERN_COUNT   (sizeof(patterns) / sizeof(patterns[0]))
+
+/* Q15 sin/cos are off by at most half an LSB, 2^-16, so relative to the
+ * exact rotation the output is off by up to ~sqrt(2) * 2^-16 of the
+ * distance moved. the carried remainder keeps the rounding part at half a
+ * count, however long it runs */
+#define ROT_TABLE_ERR   (2.0 / 65536.0)
+#define ROT_ROUND_ERR   1.0
+
+/* the interpolated gain is truncated to Q8.8, so up to 1/256 low */
+#define GAIN_ERR        (1.0 / 256.0)
+
+static int failures;
+
+static void check(const char *what, int deg, const char *name, double got, double want, double bound) {
+
+    double err = fabs(got - want);
+
+    if (err > bound) {
+        printf("FAIL %-8s angle %4d, %-14s: got %.1f, want %.3f, error %.3f > %.3f\n",
+               what, deg, name, got, want, err, bound);
+        failures++;
+    }
+
+}
+
+/* the reference. speed uses the same max + min/2 estimate the firmware does,
+ * that's the curve's definition rather than an approximation of it */
+static double ref_gain(const uint16_t *gain, uint8_t shift, double x, double y) {
+
+    double ax = fabs(x), ay = fabs(y);
+    double hi = (ax > ay) ? ax : ay;
+    double lo = (ax > ay) ? ay : ax;
+    double pos = (hi + floor(lo / 2)) / (1 << shift);
+
+    if (pos >= MOTION_CURVE_POINTS - 1) {
+        return gain[MOTION_CURVE_POINTS - 1] / 256.0;
+    }
+
+    int    i = (int)pos;
+    double f = pos - i;
+    return (gain[i] + (gain[i + 1] - gain[i]) * f) / 256.0;
+
+}
+
+static void load_curve(const uint16_t *gain, uint8_t enable, uint8_t shift) {
+
+    for (uint8_t i = 0; i < MOTION_CURVE_POINTS; i++) {
+        motion_curve_set_point(i, gain[i]);
+    }
+    motion_curve_commit(enable, shift);
+
+}
+
+/* every angle, every pattern, curve off. the error must stay within the
+ * table error plus one rounding step, not grow with the number of frames */
+static void test_rotation(void) {
+
+    for (int deg = MOTION_ANGLE_MIN; deg <= MOTION_ANGLE_MAX; deg++) {
+
+        double rad = deg * M_PI / 180.0;
+
+        for (unsigned p = 0; p < PATTERN_COUNT; p++) {
+
+            const struct pattern *pt = &patterns[p];
+            double sum_x = 0, sum_y = 0, ref_x = 0, ref_y = 0, dist = 0;
+
+            motion_set_angle(deg);
+
+            for (int n = 0; n < pt->frames; n++) {
+
+                int16_t dx = pt->dx, dy = pt->dy;
+                motion_apply(&dx, &dy);
+
+                sum_x += dx;
+                sum_y += dy;
+                ref_x += pt->dx * cos(rad) - pt->dy * sin(rad);
+                ref_y += pt->dx * sin(rad) + pt->dy * cos(rad);
+                dist  += hypot(pt->dx, pt->dy);
+            }
+
+            double bound = ROT_ROUND_ERR + dist * ROT_TABLE_ERR;
+            check("rotate x", deg, pt->name, sum_x, ref_x, bound);
+            check("rotate y", deg, pt->name, sum_y, ref_y, bound);
+        }
+    }
+
+}
+
+/* angle 0, so only the curve acts. a few shapes at every step size */
+static void test_curve(void) {
+
+    uint16_t curves[3][MOTION_CURVE_POINTS];
+
+    for (int i = 0; i < MOTION_CURVE_POINTS; i++) {
+        curves[0][i] = MOTION_GAIN_ONE;                 /* flat 1.0x */
+        curves[1][i] = 128 + i * 40;                    /* 0.5x rising to ~2.8x */
+        curves[2][i] = (i & 1) ? 700 : 90;              /* jagged, worst for interpolation */
+    }
+
+    motion_set_angle(0);
+
+    for (unsigned c = 0; c < 3; c++) {
+        for (uint8_t shift = 0; shift <= MOTION_CURVE_SHIFT_MAX; shift++) {
+
+            load_curve(curves[c], 1, shift);
+
+            for (unsigned p = 0; p < PATTERN_COUNT; p++) {
+
+                const struct pattern *pt = &patterns[p];
+                double sum_x = 0, sum_y = 0, ref_x = 0, ref_y = 0, moved = 0;
+                double g = ref_gain(curves[c], shift, pt->dx, pt->dy);
+
+                for (int n = 0; n < pt->frames; n++) {
+
+                    int16_t dx = pt->dx, dy = pt->dy;
+                    motion_apply(&dx, &dy);
+
+                    sum_x += dx;
+                    sum_y += dy;
+                    ref_x += pt->dx * g;
+                    ref_y += pt->dy * g;
+                    moved += fabs((double)pt->dx) + fabs((double)pt->dy);
+                }
+
+                /* skip what the report clamp legitimately cuts off */
+                if (fabs(pt->dx * g) > INT16_MAX || fabs(pt->dy * g) > INT16_MAX) {
+                    continue;
+                }
+
+                double bound = 1.0 + moved * GAIN_ERR;
+                check("curve x", shift, pt->name, sum_x, ref_x, bound);
+                check("curve y", shift, pt->name, sum_y, ref_y, bound);
+            }
+        }
+    }
+
+    motion_curve_commit(0, 0);
+
+}
+
+/* both stages, with a flat gain so the rotated speed can't pick a different
+ * segment than the reference does */
+static void test_combined(void) {
+
+    uint16_t flat[MOTION_CURVE_POINTS];
+
+    for (int i = 0; i < MOTION_CURVE_POINTS; i++) {
+        flat[i] = 400;
+    }
+
+    for (int deg = MOTION_ANGLE_MIN; deg <= MOTION_ANGLE_MAX; deg += 5) {
+
+        double rad = deg * M_PI / 180.0;
+
+        motion_set_angle(deg);
+
+        for (unsigned p = 0; p < PATTERN_COUNT - 1; p++) {
+
+            const struct pattern *pt = &patterns[p];
+            double sum_x = 0, sum_y = 0, ref_x = 0, ref_y = 0, dist = 0;
+
+            load_curve(flat, 1, 4);
+
+            for (int n = 0; n < pt->frames; n++) {
+
+                int16_t dx = pt->dx, dy = pt->dy;
+                motion_apply(&dx, &dy);
+
+                sum_x += dx;
+                sum_y += dy;
+                ref_x += (pt->dx * cos(rad) - pt->dy * sin(rad)) * 400 / 256;
+                ref_y += (pt->dx * sin(rad) + pt->dy * cos(rad)) * 400 / 256;
+                dist  += hypot(pt->dx, pt->dy);
+            }
+
+            /* the rotation's rounding error gets scaled by the gain too */
+            double bound = (ROT_ROUND_ERR + dist * ROT_TABLE_ERR) * 400 / 256 + 1.0;
+            check("both x", deg, pt->name, sum_x, ref_x, bound);
+            check("both y", deg, pt->name, sum_y, ref_y, bound);
+        }
+    }
+
+    motion_curve_commit(0, 0);
+
+}
+
+/* the reported angle is wrapped into (-180, 180] */
+static void test_angle_wrap(void) {
+
+    const int16_t in[]   = { 0, 90, 180, -180, 270, -270, 360, 719, -721 };
+    const int16_t want[] = { 0, 90, 180,  180, -90,   90,   0,  -1,   -1 };
+
+    for (unsigned i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+        motion_set_angle(in[i]);
+        if (motion_get_angle() != want[i]) {
+            printf("FAIL angle wrap: %d -> %d, want %d\n", in[i], motion_get_angle(), want[i]);
+            failures++;
+        }
+    }
+
+}
+
+int main(void) {
+
+    test_angle_wrap();
+    test_rotation();
+    test_curve();
+    test_combined();
+
+    printf("motion: %s (%d failures)\n", failures ? "FAIL" : "ok", failures);
+
+    return failures ? 1 : 0;
+
+}